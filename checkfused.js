@@ -0,0 +1,77 @@
+// Checks that the "fused" programs in main.cpp's bench() are what compiler.ojs's peephole pass makes of the programs they
+// are benchmarked against, so that the before / after instruction counts are about what the compiler actually emits.
+// The plain-JS part of compiler.ojs (everything from BMLCompiler.initialize on) is evaluated as it is, w/o OMeta.
+// Run it w/ node (or make check-fused).
+
+var fs          = require("fs")
+var dir         = __dirname + "/"
+var compilerSrc = fs.readFileSync(dir + "compiler.ojs", "utf8"),
+    mainSrc     = fs.readFileSync(dir + "main.cpp", "utf8")
+var BMLCompiler = {}
+eval(compilerSrc.slice(compilerSrc.indexOf("BMLCompiler.initialize"), compilerSrc.indexOf("//tree =")))
+
+// splits s at the commas that aren't nested in parentheses
+function splitArgs(s) { var args = [], depth = 0, start = 0
+                        for (var i = 0; i < s.length; i++)
+                          if (s[i] == "(") depth++
+                          else if (s[i] == ")") depth--
+                          else if (s[i] == "," && depth == 0) {
+                            args.push(s.slice(start, i).trim())
+                            start = i + 1
+                          }
+                        args.push(s.slice(start).trim())
+                        return args }
+
+// an Int operand whose value is a C expression (e.g., Int(m)) is still a number as far as the peephole pass is concerned
+var symbolicInts = []
+function operand(a) { var n = /^Int\((.*)\)$/.exec(a)
+                      if (a == "nil")
+                        return null
+                      else if (n != null && /^-?\d+$/.test(n[1]))
+                        return parseInt(n[1])
+                      else if (n != null) {
+                        if (symbolicInts.indexOf(n[1]) < 0)
+                          symbolicInts.push(n[1])
+                        return 1e9 + symbolicInts.indexOf(n[1])
+                      }
+                      return a.replace(/\b(l\d+)F\b/g, "$1") } // (a fused lambda is compared w/ what it's fused from)
+
+// answers the instructions of mkCode(n, op, operand, ...), w/ args being what's between its parentheses
+function instrs(args, where) { var as = splitArgs(args.replace(/\/\/.*$/gm, "")), is = []
+                               if (parseInt(as[0]) * 2 != as.length - 1)
+                                 throw where + ": mkCode(" + as[0] + ", ...) has " + (as.length - 1) / 2 + " instructions"
+                               for (var i = 1; i < as.length; i += 2)
+                                 is.push(BMLCompiler.instr(as[i], operand(as[i + 1])))
+                               return is }
+
+function show(is) { return is.map(function(i) { return i.op + " " + (i.arg === null ? "nil" : i.arg >= 1e9 ? symbolicInts[i.arg - 1e9] :
+                                                                     i.arg) }).join(", ") }
+
+function check(what, prog, fusedProg) { // (peephole() annotates its input, hence the copy)
+  var got  = show(BMLCompiler.peephole(progs[prog].map(function(i) { return BMLCompiler.instr(i.op, i.arg) }))),
+      want = show(progs[fusedProg])
+  numChecked++
+  if (got != want) {
+    console.log(what + ": " + fusedProg + " isn't what the peephole pass makes of " + prog + "\n  peephole: " + got +
+                "\n  main.cpp: " + want)
+    failed = true
+  }
+}
+
+// the programs are (re)assigned in order, so the ones that a benchFused() call compares are the latest ones
+var body = mainSrc.slice(mainSrc.indexOf("\nvoid bench(double initSecs")), progs = {}, numChecked = 0, failed = false
+var re   = /(?:value_t\s+)?(\w+)\s*=\s*addGlobal\(mkCode\(|benchFused\("([^"]*)",\s*(\w+),\s*(\w+)\)/g
+for (var m; (m = re.exec(body)) != null; ) {
+  if (m[1] === undefined) {
+    check(m[2], m[3], m[4])
+    continue
+  }
+  var start = re.lastIndex, depth = 1, i = start
+  for (; depth > 0; i++)
+    depth += body[i] == "(" ? 1 : body[i] == ")" ? -1 : 0
+  progs[m[1]] = instrs(body.slice(start, i - 1), m[1])
+  if (/^l\d+F$/.test(m[1])) // a fused lambda is checked against the one it's fused from
+    check(m[1], m[1].slice(0, -1), m[1])
+}
+console.log(numChecked + " fused programs checked" + (failed ? ", some of them are wrong" : ""))
+process.exit(failed || numChecked == 0 ? 1 : 0)
@@ -3,6 +3,22 @@
 #include <stdarg.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <errno.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 // TODO: introduce threads: each thread holds onto a context (prio. 0)
 // TODO: exceptions (prio. 1)
@@ -23,41 +39,228 @@
 //                     oldFp                         load/store(2)
 //                     oldIpb                        load/store(3)
 //                     oldIp                         load/store(4)
+//
+// The function and its arguments are passed by value, i.e., they're in the stack slots themselves. (Box, Unbox, and StVar
+// are there for variables that are captured and assigned to, which have to live in a box that the closures can share.)
 
-int debug = 0, initDone = 0;
+int debug = 0, initDone = 0, weakSymbols = 0; // when weakSymbols is set (see the WEAK_SYMBOLS environment variable), the
+                                              // symbol table doesn't keep its strings alive
 
 typedef unsigned char byte_t;
-typedef int           value_t;
-
-value_t nil, stack, ipb, ip, fp, sp, globals, internedStringsRef, chars,                 // registers, etc.
-        Obj, Nil, Int, Str, Var, Closure, Class,                                         // classes
-        sIntern, sIdentityHash, sPrint, sPrintln, sAdd, sSub, sMul;                      // selectors
+#ifdef VALUE32
+typedef int32_t       value_t; // the old layout, for comparison (see the bench32 target in the Makefile)
+#else
+typedef int64_t       value_t;
+#endif
+
+value_t nil, internedStringsRef, chars, classesRef,                                      // roots, etc.
+        stdOut,                                                                          // the OutStream instance
+        Obj, Nil, Int, Str, Var, Closure, Class, OutStream,                              // classes
+        sIntern, sIdentityHash, sPrint, sPrintln, sAdd, sSub, sMul, sLt,                 // selectors
+        sWrite, sFlush, sFlushLines, sFlushExplicitly, sFlushEvery;
+__thread value_t stack, ipb, ip, fp, sp; // the registers: every worker (see runThreads) has its own
 
 #define allocate(N, T) ((T *) calloc(N, sizeof(T)))                                      // calloc fills memory w/ 0s, i.e., nils
 
 #define isInt(X)            ((X) & 1)                                                    // integers are tagged (lsb = 1)
-#define Int(X)              (((X) << 1) | 1)
+#define IntBits             (8 * (int)sizeof(value_t) - 1)                               // i.e., 63 (or 31)
+#define fitsInt(X)          ((X) >= -((value_t)1 << (IntBits - 1)) && (X) < ((value_t)1 << (IntBits - 1)))
+#define Int(X)              (((value_t)(X) << 1) | 1)
 #define IntValue(X)         ({ value_t _x = X; if (debug) assert(isInt(_x)); _x >> 1; })
 
 #define isOop(X)            (((X) & 1) == 0)
-#define Oop(X)              ((X) << 1)
+#define Oop(X)              ((value_t)(X) << 1)
 #define OopValue(X)         ({ value_t _x = X; if (debug) assert(isOop(_x)); _x >> 1; })
 
-typedef struct OTEntry { value_t numSlots, cls;
-                         int isBinary;
+typedef struct OTEntry { int32_t numSlots;  /* an Int (Int(-1) for a free entry), in 32 bits even when value_t is 64 */
+                         byte_t  isBinary;  /* (the mark bits are in marked, and a body's size class is in its slab) */
+                         byte_t  isContext; /* see numLiveSlots */
+                         value_t cls;
                          union { value_t *slots;
                                  struct OTEntry *next; } ptr;                                                  } OTEntry;
 
-typedef struct         { value_t name, slotNames, numSlots, vTableSize, sels, impls, super;                    } classSlots;
+typedef struct         { value_t name, slotNames, numSlots, vTableSize, sels, impls, super,
+                                 definers, numMethods; /* see methodIdx */                                     } classSlots;
+
+typedef struct         { value_t caller, code, ip, sp, fp, id, result; /* followed by stack: fvs, tmps, recv, args, ... */ } contextSlots;
+
+const int ContextHeaderSlots = sizeof(contextSlots) / sizeof(value_t), InitialStackSize = 64, MaxStackSize = 1024 * 1024;
+#define ctxSlot(field)                    Int(offsetof(contextSlots, field) / sizeof(value_t))
+
+typedef struct         { value_t tally, numUsed, hashes, strings; /* numUsed includes tombstones */          } symbolTableSlots;
 
-typedef struct         { value_t caller, code, ip, sp, fp; /* followed by stack: fvs, tmps, recv, args, ... */ } contextSlots;
+// A string's body is binary: the length and (once strHash has computed it) the hash, followed by the bytes, padded w/ 0s
+// to a multiple of 8 bytes (w/ at least one 0, so that StrCmp can read whole words without looking at the length).
+typedef struct         { value_t length, hash; /* 0 means not computed yet */ byte_t bytes[];                 } strSlots;
+
+const size_t PICSize = 4; // a send cache w/ more than this many (class, selector) pairs goes megamorphic
+
+typedef struct         { value_t cls, sel, method;                                                             } sendCacheEntry;
+typedef struct         { value_t nArgs, epoch, numEntries; /* Int(-1) means megamorphic */
+                         value_t intSends;  /* type feedback, see profileSend */
+                         sendCacheEntry entries[PICSize];                                                      } sendCacheSlots;
 
 const size_t OrigOTSize = 2; // must be >= 2
-size_t OTSize = 0;
+size_t OTSize = 0, numFreeEntries = 0;
 OTEntry *OT, *freeList;
-byte_t *marked;
+byte_t *marked, *remembered;
+int *allocSiteOf; // the allocation site of each object that the heap profiler sampled, or 0, see sampleAllocSite()
+int *jitInfo;     // for a code array: how many times it's been entered, JitNever, or -2 - its index in jitFunctions
+const int JitNever = -1;
+
+// Generational GC: the bodies of small objects are bump-allocated in the nursery, each one preceded by a header word that
+// holds its OT index. A minor collection (minorGC) copies the young objects that are reachable from the roots or from the
+// remembered set (the old objects that the write barrier has seen a young reference being stored into) to the old space,
+// i.e., the malloc heap, frees the OT entries of the rest, and empties the nursery. Everything goes through the OT, so
+// moving a body only means updating its OT entry. gc() is the full collection; it also empties the nursery. Each worker
+// (see runThreads) has a nursery of its own, and they're all in one block, so inNursery is still a single comparison; a
+// collection empties all of them.
+
+const size_t NurserySize = 256 * 1024, MaxYoungSlots = 64; // in words; bigger objects are allocated in the old space
+const int    MaxWorkers  = 16;
+int numWorkers = 1;        // the workers that are running green threads, see runThreads()
+__thread int workerId = 0; // the main thread is worker 0
+value_t *nursery;          // MaxWorkers nurseries, one after the other
+__thread value_t *nurseryTop, *nurseryEnd; // the current worker's (the others' are in workers[], see publish())
+int *rememberedSet, *gcWorklist;
+size_t rememberedSetSize = 0, rememberedSetCapacity = 0, gcWorklistSize = 0, gcWorklistCapacity = 0;
+
+#define inNursery(p)                      ((uintptr_t)(p) - (uintptr_t)nursery < MaxWorkers * NurserySize * sizeof(value_t))
+#define nurseryOf(w)                      (nursery + (w) * NurserySize)
+
+value_t *compacted, *compactedEnd; // the block that holds the bodies that compact() has moved
+#define inCompacted(p)                    ((uintptr_t)(p) - (uintptr_t)compacted < (uintptr_t)compactedEnd - (uintptr_t)compacted)
+value_t *imageBodies, *imageEnd;   // the (mmap-ed) bodies of the objects that came from an image, see loadImage()
+void    *imageMapping;
+size_t   imageMappingSize;
+#define inImage(p)                        ((uintptr_t)(p) - (uintptr_t)imageBodies < (uintptr_t)imageEnd - (uintptr_t)imageBodies)
+#define ownsBody(p)                       (!inCompacted(p) && !inImage(p)) // i.e., it came from allocBody()
+#define isYoung(otIdx)                    inNursery(OT[otIdx].ptr.slots)
+
+#define pushIdx(a, size, capacity, i)  ({ if (size == capacity) {                                                   \
+                                            capacity = capacity > 0 ? capacity * 2 : 1024;                          \
+                                            a        = (int *)realloc(a, capacity * sizeof(int));                   \
+                                          }                                                                         \
+                                          a[size++] = i; })
+#define pushValue(a, size, capacity, v)  ({ if (size == capacity) {                                                   \
+                                            capacity = capacity > 0 ? capacity * 2 : 1024;                          \
+                                            a        = (value_t *)realloc(a, capacity * sizeof(value_t));           \
+                                          }                                                                         \
+                                          a[size++] = v; })
+
+// w/ several workers, what they all update (the remembered set, the free OT entries, the old space, the send caches,
+// the output buffer, ...) is locked; a single worker doesn't bother
+void lockShared  (pthread_mutex_t *lock) { if (numWorkers > 1) pthread_mutex_lock(lock);   }
+void unlockShared(pthread_mutex_t *lock) { if (numWorkers > 1) pthread_mutex_unlock(lock); }
+
+pthread_mutex_t rememberedLock = PTHREAD_MUTEX_INITIALIZER;
+
+void remember(int otIdx)                { lockShared(&rememberedLock);
+                                          if (!remembered[otIdx]) { // (another worker may have just remembered it)
+                                            __atomic_store_n(&remembered[otIdx], 1, __ATOMIC_RELAXED);
+                                            pushIdx(rememberedSet, rememberedSetSize, rememberedSetCapacity, otIdx);
+                                          }
+                                          unlockShared(&rememberedLock); }
+
+void rememberOld(int otIdx)             { if (!isYoung(otIdx) && !remembered[otIdx]) remember(otIdx); } // conservatively
+
+enum { Idle, Marking, Sweeping }; // the phases of a major collection, see mkIn()
+int gcPhase = Idle;
+void shade(value_t v);
+
+// must be called whenever a reference is stored into an object w/o going through slotAtPut
+#define writeBarrier(otIdx, val)       ({ value_t _wv = val; int _wi = otIdx;                                        \
+                                          if (isOop(_wv) && isYoung(OopValue(_wv)) && !isYoung(_wi) &&              \
+                                              !__atomic_load_n(&remembered[_wi], __ATOMIC_RELAXED))                 \
+                                            remember(_wi);                                                          \
+                                          if (gcPhase == Marking)                                                   \
+                                            shade(_wv); })
+
+// All of the VM's output to stdout goes through out, a user-space buffer that's written out w/ write(2) in bulk. When
+// that happens depends on its policy: OutLine flushes at every newline (the default when stdout is a terminal, and in
+// debug mode, so that nothing is lost if an assertion fails), OutSize once flushSize bytes have piled up, and OutExplicit
+// only when the buffer is full or someone calls outFlush (e.g., by sending flush to stdOut). The OUTPUT_FLUSH environment
+// variable overrides the default: "line", "explicit", or a number of bytes (for OutSize), and so do flushLines,
+// flushExplicitly, and flushEvery: n sent to stdOut.
+
+enum { OutLine, OutSize, OutExplicit };
+const size_t OutBufSize = 64 * 1024;
+struct { int fd, policy; size_t len, flushSize; char buf[OutBufSize]; } out = { 1, OutSize, 0, OutBufSize };
+pthread_mutex_t outLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP; // (outWrite flushes, and so on)
+
+void writeAll(int fd, const char *bytes, size_t n) {
+  while (n > 0) {
+    ssize_t w = write(fd, bytes, n);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return; // (there's nowhere to report this)
+    bytes += w;
+    n     -= w;
+  }
+}
+
+void outFlush(void)                     { lockShared(&outLock);
+                                          writeAll(out.fd, out.buf, out.len); out.len = 0;
+                                          unlockShared(&outLock); }
+
+void outWritten(const char *bytes, size_t n) { // applies the policy after n bytes were added to the buffer
+  if (out.policy == OutLine ? memchr(bytes, '\n', n) != NULL : out.policy == OutSize && out.len >= out.flushSize)
+    outFlush();
+}
+
+void outWrite(const char *bytes, size_t n) {
+  lockShared(&outLock);
+  if (out.len + n > OutBufSize) {
+    outFlush();
+    if (n > OutBufSize) {
+      writeAll(out.fd, bytes, n);
+      unlockShared(&outLock);
+      return;
+    }
+  }
+  memcpy(out.buf + out.len, bytes, n);
+  out.len += n;
+  outWritten(bytes, n);
+  unlockShared(&outLock);
+}
+
+void outChar(char c)                    { outWrite(&c, 1); }
+
+void outInt(long long i) { // (what outPrintf("%lld", i) does, w/o parsing a format)
+  char buf[21], *p = buf + sizeof(buf);
+  unsigned long long u = i < 0 ? -(unsigned long long)i : i;
+  do *--p = '0' + u % 10; while ((u /= 10) != 0);
+  if (i < 0) *--p = '-';
+  outWrite(p, buf + sizeof(buf) - p);
+}
+
+void outPrintf(const char *fmt, ...) {
+  lockShared(&outLock);
+  va_list args; va_start(args, fmt);
+  int n = vsnprintf(out.buf + out.len, OutBufSize - out.len, fmt, args); // (vsnprintf wants room for a 0 at the end)
+  va_end(args);
+  if (out.len + n < OutBufSize) {
+    out.len += n;
+    outWritten(out.buf + out.len - n, n);
+    unlockShared(&outLock);
+    return;
+  }
+  char *tmp = (char *)malloc(n + 1);
+  va_start(args, fmt); vsnprintf(tmp, n + 1, fmt, args); va_end(args);
+  outWrite(tmp, n);
+  free(tmp);
+  unlockShared(&outLock);
+}
+
+void outSetPolicy(int policy, size_t flushSize) { lockShared(&outLock);
+                                                  out.policy    = policy;
+                                                  out.flushSize = flushSize < OutBufSize ? flushSize : OutBufSize;
+                                                  outFlush();
+                                                  unlockShared(&outLock); }
 
 void vprintf2(const char *fmt, va_list args, value_t n = Int(5));
+void printValue(value_t x);
 
 void  printf2(const char *fmt, ...) { va_list args; va_start(args, fmt); vprintf2(fmt, args);                     va_end(args); }
 void dPrintf2(const char *fmt, ...) { if (!debug) return;
@@ -69,22 +272,40 @@ void    error(const char *fmt, ...) { va_list args; va_start(args, fmt); printf2
 
 void growOT(void) {
   size_t  newOTSize    = OTSize > 0 ? OTSize * 2 : OrigOTSize;
-  dPrintf2("growOT, new size is %d\n", newOTSize);
+  dPrintf2("growOT, new size is %d\n", (int)newOTSize);
   OTEntry *newOT       = allocate(newOTSize, OTEntry);
   byte_t  *newMarked   = allocate(newOTSize, byte_t);
+  byte_t  *newRemd     = allocate(newOTSize, byte_t);
+  int     *newSites    = allocate(newOTSize, int);
+  int     *newJitInfo  = allocate(newOTSize, int);
   memcpy(newOT, OT, sizeof(OTEntry) * OTSize);
-  for (int i = OTSize; i < newOTSize; i++) {
+  memcpy(newMarked, marked, OTSize); // a major collection may be in progress
+  memcpy(newRemd, remembered, OTSize);
+  memcpy(newSites, allocSiteOf, OTSize * sizeof(int));
+  memcpy(newJitInfo, jitInfo, OTSize * sizeof(int));
+  OTEntry *oldFreeList = freeList != NULL ? &newOT[freeList - OT] : NULL;
+  for (OTEntry *e = oldFreeList; e != NULL; e = e->ptr.next) // the old free entries move along w/ everything else
+    if (e->ptr.next != NULL)
+      e->ptr.next = &newOT[e->ptr.next - OT];
+  for (size_t i = OTSize; i < newOTSize; i++) {
     newOT[i].numSlots = Int(-1);
-    newOT[i].ptr.next = i + 1 < newOTSize ? &newOT[i + 1] : NULL;
+    newOT[i].ptr.next = i + 1 < newOTSize ? &newOT[i + 1] : oldFreeList;
   }
   if (OTSize > 0) {
     free(OT);
     free(marked);
+    free(remembered);
+    free(allocSiteOf);
+    free(jitInfo);
   }
-  freeList = &newOT[OTSize];
-  OTSize   = newOTSize;
-  OT       = newOT;
-  marked   = newMarked;
+  freeList        = &newOT[OTSize];
+  numFreeEntries += newOTSize - OTSize;
+  OTSize          = newOTSize;
+  OT              = newOT;
+  marked          = newMarked;
+  remembered      = newRemd;
+  allocSiteOf     = newSites;
+  jitInfo         = newJitInfo;
 }
 
 value_t mk(size_t numSlots);
@@ -104,8 +325,15 @@ value_t mk(size_t numSlots);
 
 #define slotAtPut(oop, idx, val)       ({ value_t _oop = OopValue(oop), _idx = IntValue(idx), _val = val; \
                                           dAssert(0 <= _idx && _idx < IntValue(OT[_oop].numSlots));       \
+                                          writeBarrier(_oop, _val);                                       \
                                           OT[_oop].ptr.slots[_idx] = _val; })
 
+// stores into a field of a struct-typed object (e.g., classSlots), w/ the write barrier (v is evaluated first, so it's ok
+// for v to allocate)
+#define fieldAtPut(oop, T, field, v)   ({ value_t _o = oop, _v = v;                                        \
+                                          writeBarrier(OopValue(_o), _v);                                 \
+                                          ((T *)OT[OopValue(_o)].ptr.slots)->field = _v; })
+
 value_t numSlots(value_t oop)           { dAssert(isOop(oop));
                                           return OT[OopValue(oop)].numSlots; }
 
@@ -113,7 +341,7 @@ value_t *slots(value_t oop)             { dAssert(isOop(oop));
                                           return OT[OopValue(oop)].ptr.slots; }
 
 value_t classOf(value_t x)              { return isInt(x) ? Int : OT[OopValue(x)].cls;        }
-value_t classOf_(value_t x, value_t c)  { dAssert(!isInt(x)); return OT[OopValue(x)].cls = c; }
+value_t classOf_(value_t x, value_t c)  { dAssert(!isInt(x)); writeBarrier(OopValue(x), c); return OT[OopValue(x)].cls = c; }
 
 classSlots *asClass(value_t oop)        { dAssert(isOop(oop));
                                           // TODO: replace the following assert with an instanceof (or at least class) check
@@ -125,65 +353,1102 @@ contextSlots *asContext(value_t oop)    { dAssert(isOop(oop));
                                           dAssert(numSlots(oop) > Int(sizeof(contextSlots) / sizeof(value_t)));
                                           return (contextSlots *)slots(oop); }
 
-value_t addGlobal(value_t v)            { car_(globals, v);
-                                          globals = cons(nil, globals);
+sendCacheSlots *asSendCache(value_t oop) { dAssert(isOop(oop));
+                                           dAssert(numSlots(oop) == Int(sizeof(sendCacheSlots) / sizeof(value_t)));
+                                           return (sendCacheSlots *)slots(oop); }
+
+symbolTableSlots *asSymbolTable(value_t oop) { dAssert(isOop(oop));
+                                               dAssert(numSlots(oop) == Int(sizeof(symbolTableSlots) / sizeof(value_t)));
+                                               return (symbolTableSlots *)slots(oop); }
+
+strSlots *asStr(value_t oop)            { dAssert(isOop(oop) && OT[OopValue(oop)].isBinary);
+                                          return (strSlots *)slots(oop); }
+
+// The roots: addGlobal() registers an object for good (or until forgetGlobal()) in roots, a plain C array, and C code
+// keeps its temporaries alive w/ handles, which go on a stack of their own and are dropped at the end of the
+// HandleScope that made them, e.g.,  { HandleScope; value_t s = handle(stringify("x")); ... }. Neither one costs an
+// allocation. Roots never change, so a minor collection only looks at the ones that were registered since the last
+// collection (see numOldRoots). The GC goes over the roots, the handles, and ipb w/ rootAt(). Every worker (see
+// runThreads) has handles of its own.
+//
+// Several workers can run green threads at once (see runThreads), but they never collect garbage at the same time as
+// they run code: a worker that's about to collect, or to change something that the others read w/o locking (the roots,
+// a class' methods, a module, the OT's layout), stops the world first, i.e., it asks the others to park at a safepoint
+// and waits until they have. Workers reach a safepoint whenever they allocate, when they're preempted, and when they're
+// idle, which is often enough, because a green thread can't loop w/o being preempted. A parked worker publishes its
+// registers and handles, so that rootAt() can see them, and its nursery top. Nothing stops w/ one worker (i.e., unless
+// threads are being run).
+
+value_t *roots, *otherRoots;
+size_t numRoots = 0, rootsCapacity = 0, numOldRoots = 0, numOtherRoots = 0, otherRootsCapacity = 0;
+__thread value_t *handles;
+__thread size_t   numHandles = 0, handlesCapacity = 0;
+
+value_t handle(value_t v)               { pushValue(handles, numHandles, handlesCapacity, v);
+                                          if (gcPhase == Marking) shade(v);
                                           return v; }
+void closeHandleScope(size_t *numHandlesBefore) { numHandles = *numHandlesBefore; }
+#define HandleScope                       size_t _handleScope __attribute__((cleanup(closeHandleScope))) = numHandles
+
+typedef struct { value_t stack, ipb, *handles, *nurseryTop; size_t numHandles; } workerState;
+workerState     workers[MaxWorkers];      // what each worker published when it last parked
+int             stopRequested = 0, numParked = 0, numRunning = 0; // (numRunning: the workers that haven't finished)
+__thread int    worldStopped  = 0;        // whether this worker has stopped the world
+pthread_mutex_t worldLock     = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  workerParked  = PTHREAD_COND_INITIALIZER, worldResumed = PTHREAD_COND_INITIALIZER;
+#define safepointRequested()              __atomic_load_n(&stopRequested, __ATOMIC_RELAXED)
+
+void returnFreeEntries(void);
+
+void publish(void) {
+  workerState *w = &workers[workerId];
+  w->stack      = stack;
+  w->ipb        = ipb;
+  w->handles    = handles;
+  w->numHandles = numHandles;
+  w->nurseryTop = nurseryTop;
+  if (stack != nil)
+    asContext(stack)->sp = sp; // (the GC only looks at the part of a stack that's in use)
+  returnFreeEntries();         // (a collection rebuilds the free list)
+}
 
-int mark(value_t oop) {
-  if (!isOop(oop))
-    return 0;
-  int otIdx = OopValue(oop);
-  if (marked[otIdx])
+void parkLocked(void) { // (w/ worldLock held)
+  publish();
+  numParked++;
+  pthread_cond_signal(&workerParked);
+  while (stopRequested)
+    pthread_cond_wait(&worldResumed, &worldLock);
+  numParked--;
+  nurseryTop = workers[workerId].nurseryTop; // (a minor collection empties every nursery)
+}
+
+void safepoint(void) {
+  if (worldStopped) // (e.g., it allocates)
+    return;
+  pthread_mutex_lock(&worldLock);
+  if (stopRequested)
+    parkLocked();
+  pthread_mutex_unlock(&worldLock);
+}
+
+int stopWorld(void) { // answers whether it stopped the world (not if it was stopped already, or if there's one worker)
+  if (numWorkers == 1 || worldStopped)
     return 0;
-  marked[otIdx] = 1;
-  if (OT[otIdx].isBinary)
-    return 1;
-  size_t r = 1;
-  OTEntry e = OT[otIdx];
-  value_t *slot = e.ptr.slots;
-  for (int i = 0; i < IntValue(e.numSlots); i++)
-    r += mark(*slot++);
+  pthread_mutex_lock(&worldLock);
+  while (stopRequested) // (another worker got there first)
+    parkLocked();
+  __atomic_store_n(&stopRequested, 1, __ATOMIC_RELAXED);
+  while (numParked < numRunning - 1)
+    pthread_cond_wait(&workerParked, &worldLock);
+  pthread_mutex_unlock(&worldLock);
+  returnFreeEntries();
+  for (int w = 0; w < numWorkers; w++)
+    if (w != workerId) {
+      pushValue(otherRoots, numOtherRoots, otherRootsCapacity, workers[w].stack);
+      pushValue(otherRoots, numOtherRoots, otherRootsCapacity, workers[w].ipb);
+      for (size_t h = 0; h < workers[w].numHandles; h++)
+        pushValue(otherRoots, numOtherRoots, otherRootsCapacity, workers[w].handles[h]);
+    }
+  worldStopped = 1;
+  return 1;
+}
+
+void resumeWorld(int *stopped) {
+  if (!*stopped)
+    return;
+  worldStopped  = 0;
+  numOtherRoots = 0;
+  pthread_mutex_lock(&worldLock);
+  __atomic_store_n(&stopRequested, 0, __ATOMIC_RELAXED);
+  pthread_cond_broadcast(&worldResumed);
+  pthread_mutex_unlock(&worldLock);
+}
+
+// runs the rest of the enclosing block w/ the world stopped, e.g., { StopTheWorld; ... } (anything that must survive a
+// collection has to be handled before, since waiting for the others to park may mean waiting for one of them to
+// collect)
+#define StopTheWorld                      int _worldStopped __attribute__((cleanup(resumeWorld))) = stopWorld()
+
+value_t addGlobal(value_t v)            { HandleScope;
+                                          handle(v);
+                                          StopTheWorld;
+                                          pushValue(roots, numRoots, rootsCapacity, v);
+                                          if (gcPhase == Marking) shade(v); // (like the write barrier)
+                                          return v; }
+
+void forgetGlobal(value_t v) { // (looks at the most recently added roots first)
+  HandleScope;
+  handle(v);
+  StopTheWorld;
+  for (size_t i = numRoots; i-- > 0; )
+    if (roots[i] == v) {
+      roots[i] = roots[--numRoots];
+      if (numOldRoots > i)
+        numOldRoots = i;
+      return;
+    }
+}
+
+size_t  numAllRoots(void)               { return numRoots + numHandles + 1 + numOtherRoots; }
+value_t rootAt(size_t r) { // (the other workers' come last, and only while the world is stopped)
+  if (r < numRoots)
+    return roots[r];
+  r -= numRoots;
+  return r < numHandles ? handles[r] : r == numHandles ? ipb : otherRoots[r - numHandles - 1];
+}
+
+// Every send site (a Send instruction or one of the send macros below) can have a send cache. It starts out empty, becomes
+// monomorphic after the first send, grows into a polymorphic inline cache of up to PICSize (class, selector) pairs, and then
+// goes megamorphic, at which point the site only uses the global method cache. Send caches hold onto their classes and
+// methods, so the GC keeps them valid; the method cache does not, so it's flushed on every gc(). Both are invalidated when a
+// method is installed or a class is (re-)initialized. Every worker (see runThreads) has a method cache of its own, which it
+// clears the next time it looks something up after a flush. Send caches are shared: they're read w/o locking, and filled
+// under cacheLock, entries first, so that a reader that sees numEntries sees the entries below it. The epoch only moves
+// on w/ the world stopped.
+const size_t MethodCacheSize = 1024; // must be a power of 2
+__thread sendCacheEntry methodCache[MethodCacheSize];
+__thread size_t methodCacheFlushed = 0, sendCacheHits = 0, sendCacheMisses = 0, methodCacheHits = 0, methodCacheMisses = 0;
+size_t sendCacheEpoch = 1, methodCacheFlushes = 0;
+pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+#define methodCacheIdx(cls, sel)          ((((size_t)(cls) >> 1) ^ ((size_t)(sel) >> 3)) & (MethodCacheSize - 1))
+
+void flushMethodCache(void)             { methodCacheFlushes++; }
+
+// The send profile counts sends per (selector, receiver class), see cachedLookup. It's an open-addressing table on the C
+// side, so it doesn't keep its keys alive: the counts for a selector or class that's reclaimed go to whatever reuses its
+// OT entry. Every worker counts its own sends, and runThreads() adds them up at the end.
+typedef struct { value_t sel, cls; size_t count; } sendProfileEntry;
+__thread sendProfileEntry *sendProfile;
+__thread size_t sendProfileSize = 0, sendProfileCapacity = 0;
+
+sendProfileEntry *sendProfileSlot(value_t sel, value_t cls) { // answers (sel, cls)'s entry, or the empty one for it
+  size_t mask = sendProfileCapacity - 1, i = ((size_t)cls * 31 + (size_t)sel) & mask;
+  while (sendProfile[i].count > 0 && (sendProfile[i].sel != sel || sendProfile[i].cls != cls))
+    i = (i + 1) & mask;
+  return &sendProfile[i];
+}
+
+void growSendProfile(void) {
+  sendProfileEntry *old = sendProfile;
+  size_t oldCapacity = sendProfileCapacity;
+  sendProfileCapacity = oldCapacity > 0 ? oldCapacity * 2 : 256;
+  sendProfile         = allocate(sendProfileCapacity, sendProfileEntry);
+  for (size_t i = 0; i < oldCapacity; i++)
+    if (old[i].count > 0)
+      *sendProfileSlot(old[i].sel, old[i].cls) = old[i];
+  free(old);
+}
+
+void countSend(value_t sel, value_t cls, size_t n = 1) {
+  sendProfileEntry *e = sendProfileSlot(sel, cls);
+  if (e->count == 0) {
+    if (2 * (sendProfileSize + 1) > sendProfileCapacity) { // keep it at most half full
+      growSendProfile();
+      e = sendProfileSlot(sel, cls);
+    }
+    e->sel = sel;
+    e->cls = cls;
+    sendProfileSize++;
+  }
+  e->count += n;
+}
+void invalidateSendCaches(void)         { sendCacheEpoch++;
+                                          flushMethodCache(); }
+
+// Marking is non-recursive. The sequential marker uses a fixed-size mark stack; when that overflows, the objects that
+// didn't fit are left MarkedNotScanned, and a pass over the OT picks them up once the stack is empty. When numMarkThreads > 1
+// (see the MARK_THREADS environment variable) and the OT is big enough, that many threads mark in parallel. Each of them
+// has a private stack and a shared deque that the others steal from when they run out of work, and objects are claimed w/
+// an atomic exchange on their byte in marked.
+
+enum { Unmarked = 0, Marked = 1, MarkedNotScanned = 2 };
+
+const size_t MarkStackSize = 64 * 1024, ParallelMarkMinOTSize = 64 * 1024, MaxMarkThreads = 64, MarkShareBatch = 64;
+int numMarkThreads = 1;
+int *markStack;
+size_t markStackTop = 0;
+
+size_t numShaded = 0;
+int markStackOverflowed = 0;
+
+void gray(int otIdx) { // marks an object and queues it up to be scanned
+  if (markStackTop < MarkStackSize) {
+    marked[otIdx]             = Marked;
+    markStack[markStackTop++] = otIdx;
+  }
+  else {
+    marked[otIdx]       = MarkedNotScanned;
+    markStackOverflowed = 1;
+  }
+}
+
+void shade(value_t v) {
+  if (isOop(v) && !marked[OopValue(v)]) {
+    numShaded++;
+    gray(OopValue(v));
+  }
+}
+
+// the number of an object's slots that the GC looks at: a context's stack is only live below its sp (which is in the sp
+// register for the current context, and in the header for the others), and what's above it is never read before it's
+// written again
+int numLiveSlots(int otIdx) {
+  OTEntry *e = &OT[otIdx];
+  int      n = e->isBinary ? 0 : IntValue(e->numSlots);
+  if (!e->isContext)
+    return n;
+  value_t top = Oop(otIdx) == stack ? sp : e->ptr.slots[IntValue(ctxSlot(sp))];
+  return isInt(top) && IntValue(top) >= ContextHeaderSlots && IntValue(top) < n ? IntValue(top) : n;
+}
+
+int drainMarkStack(size_t maxObjects) { // scans (at most) maxObjects gray objects, answers 1 if there are none left
+  while (1) {
+    while (markStackTop > 0) {
+      if (maxObjects-- == 0)
+        return 0;
+      int      otIdx = markStack[--markStackTop];
+      OTEntry *e     = &OT[otIdx];
+      if (e->numSlots == Int(-1)) // (a minor collection may have freed a gray object)
+        continue;
+      for (int i = 0, n = numLiveSlots(otIdx); i < n; i++)
+        shade(e->ptr.slots[i]);
+    }
+    if (!markStackOverflowed)
+      return 1;
+    markStackOverflowed = 0;
+    for (size_t i = 0; i < OTSize; i++)
+      if (marked[i] == MarkedNotScanned)
+        gray(i);
+  }
+}
+
+size_t markSequentially(void) {
+  size_t n = numShaded;
+  for (size_t r = 0; r < numAllRoots(); r++)
+    shade(rootAt(r));
+  drainMarkStack(SIZE_MAX);
+  return numShaded - n;
+}
+
+typedef struct { pthread_mutex_t lock;
+                 int *shared; size_t head, tail, sharedCapacity; // others steal from the head
+                 int *stack;  size_t top, stackCapacity;         // private
+                 size_t numMarked;                               } marker;
+
+marker markers[MaxMarkThreads];
+int numMarkThreadsStarted = 1, numMarkersDone, numIdleMarkers;
+size_t markEpoch = 0;
+pthread_mutex_t markLock  = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  markStart = PTHREAD_COND_INITIALIZER, markDone = PTHREAD_COND_INITIALIZER;
+
+#define sharedSize(m)                     (__atomic_load_n(&(m)->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&(m)->head, __ATOMIC_ACQUIRE))
+
+int markerTake(marker *m, marker *victim) { // moves work from victim's shared deque (half of it, unless it's m's) to m
+  pthread_mutex_lock(&victim->lock);
+  size_t n = victim->tail - victim->head, k = victim == m ? n : (n + 1) / 2;
+  for (size_t i = 0; i < k; i++)
+    pushIdx(m->stack, m->top, m->stackCapacity, victim->shared[victim->head + i]);
+  __atomic_store_n(&victim->head, victim->head + k, __ATOMIC_RELEASE);
+  if (victim->head == victim->tail) {
+    __atomic_store_n(&victim->head, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&victim->tail, 0, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&victim->lock);
+  return k > 0;
+}
+
+void markerShare(marker *m) { // moves the bottom half of m's private stack (the oldest work) to its shared deque
+  size_t k = m->top / 2;
+  pthread_mutex_lock(&m->lock);
+  size_t tail = m->tail;
+  for (size_t i = 0; i < k; i++)
+    pushIdx(m->shared, tail, m->sharedCapacity, m->stack[i]);
+  __atomic_store_n(&m->tail, tail, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&m->lock);
+  memmove(m->stack, m->stack + k, (m->top - k) * sizeof(int));
+  m->top -= k;
+}
+
+void runMarker(int id) {
+  marker *m = &markers[id];
+  while (1) {
+    while (m->top > 0) {
+      int      otIdx = m->stack[--m->top];
+      OTEntry *e     = &OT[otIdx];
+      for (int i = 0, n = numLiveSlots(otIdx); i < n; i++) {
+        value_t v = e->ptr.slots[i];
+        if (isOop(v) && !marked[OopValue(v)] && __atomic_exchange_n(&marked[OopValue(v)], Marked, __ATOMIC_RELAXED) == Unmarked) {
+          m->numMarked++;
+          pushIdx(m->stack, m->top, m->stackCapacity, OopValue(v));
+        }
+      }
+      if (m->top > 2 * MarkShareBatch && sharedSize(m) == 0)
+        markerShare(m);
+    }
+    if (markerTake(m, m))
+      continue;
+    int stole = 0;
+    for (int k = 1; k < numMarkThreads && !stole; k++)
+      stole = markerTake(m, &markers[(id + k) % numMarkThreads]);
+    if (stole)
+      continue;
+    // out of work: we're done once every marker is idle (nobody shares work while they're idle, so there's none left)
+    __atomic_add_fetch(&numIdleMarkers, 1, __ATOMIC_SEQ_CST);
+    while (1) {
+      if (__atomic_load_n(&numIdleMarkers, __ATOMIC_SEQ_CST) == numMarkThreads)
+        return;
+      int anyWork = 0;
+      for (int k = 0; k < numMarkThreads && !anyWork; k++)
+        anyWork = sharedSize(&markers[k]) > 0;
+      if (anyWork) {
+        __atomic_sub_fetch(&numIdleMarkers, 1, __ATOMIC_SEQ_CST);
+        break;
+      }
+      sched_yield();
+    }
+  }
+}
+
+void *markThreadMain(void *arg) {
+  int id = (int)(intptr_t)arg;
+  size_t epoch = 0;
+  while (1) {
+    pthread_mutex_lock(&markLock);
+    while (markEpoch == epoch)
+      pthread_cond_wait(&markStart, &markLock);
+    epoch = markEpoch;
+    pthread_mutex_unlock(&markLock);
+    runMarker(id);
+    pthread_mutex_lock(&markLock);
+    numMarkersDone++;
+    pthread_cond_signal(&markDone);
+    pthread_mutex_unlock(&markLock);
+  }
+  return NULL;
+}
+
+size_t markInParallel(void) {
+  if (numMarkThreadsStarted == 1)
+    pthread_mutex_init(&markers[0].lock, NULL);
+  for (; numMarkThreadsStarted < numMarkThreads; numMarkThreadsStarted++) {
+    pthread_mutex_init(&markers[numMarkThreadsStarted].lock, NULL);
+    pthread_t t;
+    if (pthread_create(&t, NULL, markThreadMain, (void *)(intptr_t)numMarkThreadsStarted) != 0)
+      error("couldn't start a mark thread");
+    pthread_detach(t);
+  }
+  for (int k = 0; k < numMarkThreads; k++)
+    markers[k].numMarked = 0;
+  if (stack != nil)
+    asContext(stack)->sp = sp; // (the registers are this thread's, see numLiveSlots)
+  for (size_t r = 0; r < numAllRoots(); r++) {
+    value_t root = rootAt(r);
+    if (isOop(root) && !marked[OopValue(root)]) {
+      marked[OopValue(root)] = Marked;
+      markers[0].numMarked++;
+      pushIdx(markers[0].stack, markers[0].top, markers[0].stackCapacity, OopValue(root));
+    }
+  }
+  numIdleMarkers = 0;
+  pthread_mutex_lock(&markLock);
+  numMarkersDone = 0;
+  markEpoch++;
+  pthread_cond_broadcast(&markStart);
+  pthread_mutex_unlock(&markLock);
+  runMarker(0);
+  pthread_mutex_lock(&markLock);
+  while (numMarkersDone < numMarkThreads - 1)
+    pthread_cond_wait(&markDone, &markLock);
+  pthread_mutex_unlock(&markLock);
+  size_t r = 0;
+  for (int k = 0; k < numMarkThreads; k++)
+    r += markers[k].numMarked;
   return r;
 }
 
-size_t gc(void) {
+size_t markRoots(void) { // marks everything that's reachable from the roots, answers the number of objects that it marked
+  return numMarkThreads > 1 && OTSize >= ParallelMarkMinOTSize ? markInParallel() : markSequentially();
+}
+
+#define Tombstone Int(0) // marks a symbol table entry whose string was reclaimed
+
+value_t weakStrings(void) { // answers the symbol table's strings if the table is weak, otherwise nil
+  return weakSymbols && initDone ? asSymbolTable(deref(internedStringsRef))->strings : nil; // init() holds onto lots of symbols
+}
+
+void freeEntry(int otIdx) {
+  OT[otIdx].numSlots = Int(-1);
+  OT[otIdx].cls      = nil;
+  OT[otIdx].ptr.next = freeList;
+  freeList           = &OT[otIdx];
+  numFreeEntries++;
+}
+
+// While several workers are running (see runThreads), each one allocates from a batch of free entries of its own, so
+// that only taking a batch, and allocating bodies in the old space, needs heapLock. The batches go back before a
+// collection.
+const size_t FreeEntryBatch = 256;
+__thread OTEntry *localFreeList;
+__thread size_t   numLocalFreeEntries = 0;
+pthread_mutex_t   heapLock = PTHREAD_MUTEX_INITIALIZER;
+
+void takeFreeEntries(void) {
+  lockShared(&heapLock);
+  OTEntry **last = &localFreeList;
+  for (; freeList != NULL && numLocalFreeEntries < FreeEntryBatch; numLocalFreeEntries++, numFreeEntries--) {
+    *last    = freeList;
+    last     = &freeList->ptr.next;
+    freeList = freeList->ptr.next;
+  }
+  *last = NULL;
+  unlockShared(&heapLock);
+}
+
+void returnFreeEntries(void) {
+  if (localFreeList == NULL)
+    return;
+  lockShared(&heapLock);
+  OTEntry *e = localFreeList;
+  while (e->ptr.next != NULL)
+    e = e->ptr.next;
+  e->ptr.next          = freeList;
+  freeList             = localFreeList;
+  numFreeEntries      += numLocalFreeEntries;
+  localFreeList        = NULL;
+  numLocalFreeEntries  = 0;
+  unlockShared(&heapLock);
+}
+
+// The bodies of old objects come from a segregated size-class allocator. A body w/ at most MaxSlabSlots slots is carved
+// out of a slab, i.e., a SlabSize-aligned chunk of memory that only holds bodies of one size class, so the slab that a body
+// belongs to is found by masking its address. The free cells of a slab are linked through their first words (as word
+// offsets from the start of the slab). Bigger bodies come straight from malloc. Slabs that become empty stay around until
+// the end of the sweep, which releases all but one of them per size class.
+
+const size_t SlabSize = 64 * 1024, MaxSlabSlots = 64; // in bytes and slots, respectively
+
+typedef struct slab { struct slab *next, *prev; /* the size class's slabs that have room */
+                      size_t numUsed; value_t freeCell; int sizeClass;                                        } slab;
+typedef struct      { size_t cellSize, capacity; slab *slabs;
+                      size_t numSlabs, numAllocs, numFrees, numLive, numSlotsLive; /* live bodies, and their slots */ } sizeClass;
+
+const size_t SlabHeaderSize = (sizeof(slab) + sizeof(value_t) - 1) / sizeof(value_t); // in words
+const int    NumSizeClasses = 24, LargeObjects = NumSizeClasses; // the stats for the large objects come after the others
+sizeClass sizeClasses[NumSizeClasses + 1];
+__thread size_t mkCounts[NumSizeClasses + 1], mkWords[NumSizeClasses + 1]; // every mkIn(), young or old, by size class
+byte_t sizeClassOf[MaxSlabSlots + 1];
+
+void initSizeClasses(void) { // 1-16 words, then 4 classes for each doubling up to MaxSlabSlots
+  int c = 0;
+  for (size_t cellSize = 1, step = 1; cellSize <= MaxSlabSlots; cellSize += step, c++) {
+    sizeClasses[c].cellSize = cellSize;
+    sizeClasses[c].capacity = (SlabSize / sizeof(value_t) - SlabHeaderSize) / cellSize;
+    if (cellSize >= 16 && (cellSize & (cellSize - 1)) == 0)
+      step = cellSize / 4;
+  }
+  assert(c == NumSizeClasses);
+  for (size_t n = 0, c = 0; n <= MaxSlabSlots; n++) {
+    while (sizeClasses[c].cellSize < n)
+      c++;
+    sizeClassOf[n] = c;
+  }
+}
+
+#define slabOf(body)                      ((slab *)((uintptr_t)(body) & ~(uintptr_t)(SlabSize - 1)))
+
+void linkSlab(sizeClass *c, slab *s)    { s->prev = NULL; s->next = c->slabs;
+                                          if (c->slabs != NULL) c->slabs->prev = s;
+                                          c->slabs = s; }
+void unlinkSlab(sizeClass *c, slab *s)  { if (s->prev != NULL) s->prev->next = s->next; else c->slabs = s->next;
+                                          if (s->next != NULL) s->next->prev = s->prev; }
+
+value_t *allocBody(size_t numSlots) { // the body's slots are *not* initialized
+  if (numSlots > MaxSlabSlots) {
+    sizeClasses[LargeObjects].numAllocs++;
+    sizeClasses[LargeObjects].numLive++;
+    sizeClasses[LargeObjects].numSlotsLive += numSlots;
+    return (value_t *)malloc(numSlots * sizeof(value_t));
+  }
+  sizeClass *c = &sizeClasses[sizeClassOf[numSlots]];
+  slab      *s = c->slabs;
+  if (s == NULL) {
+    if (posix_memalign((void **)&s, SlabSize, SlabSize) != 0)
+      error("out of memory");
+    s->numUsed   = 0;
+    s->sizeClass = c - sizeClasses;
+    s->freeCell  = 0;
+    for (size_t i = c->capacity; i-- > 0; ) {
+      value_t *cell = (value_t *)s + SlabHeaderSize + i * c->cellSize;
+      *cell       = s->freeCell;
+      s->freeCell = cell - (value_t *)s;
+    }
+    linkSlab(c, s);
+    c->numSlabs++;
+  }
+  value_t *body = (value_t *)s + s->freeCell;
+  s->freeCell = *body;
+  if (++s->numUsed == c->capacity)
+    unlinkSlab(c, s); // it's full
+  c->numAllocs++;
+  c->numLive++;
+  c->numSlotsLive += c->cellSize;
+  return body;
+}
+
+void freeBody(value_t *body, size_t numSlots) {
+  if (numSlots > MaxSlabSlots) {
+    sizeClasses[LargeObjects].numFrees++;
+    sizeClasses[LargeObjects].numLive--;
+    sizeClasses[LargeObjects].numSlotsLive -= numSlots;
+    free(body);
+    return;
+  }
+  slab      *s = slabOf(body);
+  sizeClass *c = &sizeClasses[s->sizeClass];
+  if (s->numUsed-- == c->capacity)
+    linkSlab(c, s); // it has room again
+  *body       = s->freeCell;
+  s->freeCell = body - (value_t *)s;
+  c->numFrees++;
+  c->numLive--;
+  c->numSlotsLive -= c->cellSize;
+}
+
+void releaseEmptySlabs(void) {
+  for (int i = 0; i < NumSizeClasses; i++) {
+    sizeClass *c = &sizeClasses[i];
+    int kept = 0;
+    for (slab *s = c->slabs, *next; s != NULL; s = next) {
+      next = s->next;
+      if (s->numUsed > 0 || !kept++)
+        continue;
+      unlinkSlab(c, s);
+      free(s);
+      c->numSlabs--;
+    }
+  }
+}
+
+struct { size_t minorGCs, majorGCs, marked, reclaimed, promoted; } gcCounts; // marked counts the survivors of the sweeps
+
+void promote(int otIdx) { // copies a young object's body to the old space
+  gcCounts.promoted++;
+  OTEntry *e    = &OT[otIdx];
+  size_t   n    = IntValue(e->numSlots);
+  value_t *body = allocBody(n);
+  memcpy(body, e->ptr.slots, n * sizeof(value_t));
+  e->ptr.slots = body;
+}
+
+void forgetRemembered(void) {
+  for (size_t i = 0; i < rememberedSetSize; i++)
+    remembered[rememberedSet[i]] = 0;
+  rememberedSetSize = 0;
+}
+
+void evacuate(value_t oop) { // promotes oop if it's young (its slots are scanned later, see minorGC)
+  if (!isOop(oop) || !isYoung(OopValue(oop)))
+    return;
+  promote(OopValue(oop));
+  pushIdx(gcWorklist, gcWorklistSize, gcWorklistCapacity, OopValue(oop));
+}
+
+void evacuateReferents(int otIdx) {
+  OTEntry *e = &OT[otIdx];
+  evacuate(e->cls);
+  for (int i = 0, n = numLiveSlots(otIdx); i < n; i++)
+    evacuate(e->ptr.slots[i]);
+}
+
+value_t *nurseryTopOf(int w)            { return w == workerId ? nurseryTop : workers[w].nurseryTop; }
+void     emptyNurseries(void)           { for (int w = 0; w < MaxWorkers; w++)
+                                            workers[w].nurseryTop = nurseryOf(w);
+                                          nurseryTop = nurseryOf(workerId); }
+
+// pause times, in log2(microseconds) buckets: bucket 0 is < 1us, bucket i is [2^(i-1), 2^i) us
+enum { MinorGCPause, MarkStepPause, SweepPause, MajorGCPause, CompactionPause, AllocPause, NumPauseKinds };
+const size_t NumPauseBuckets = 24;
+size_t pauseCounts[NumPauseKinds][NumPauseBuckets];
+double pauseTotals[NumPauseKinds], pauseMaxes[NumPauseKinds];
+const char *pauseNames[NumPauseKinds] = { "minor GC", "mark step", "sweep step", "major GC", "compaction", "allocation" };
+
+double now(void) { struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t); return t.tv_sec + t.tv_nsec / 1e9; }
+
+void recordPause(int kind, double start) {
+  double secs = now() - start;
+  size_t us = secs * 1e6, bucket = 0;
+  for (; us > 0 && bucket < NumPauseBuckets - 1; us >>= 1)
+    bucket++;
+  pauseCounts[kind][bucket]++;
+  pauseTotals[kind] += secs;
+  if (secs > pauseMaxes[kind])
+    pauseMaxes[kind] = secs;
+}
+
+size_t minorGC(void) {
+  double  start = now();
+  value_t weak  = weakStrings();
+  for (size_t r = numOldRoots; r < numAllRoots(); r++) // (the other roots are old)
+    evacuate(rootAt(r));
+  for (size_t i = 0; i < rememberedSetSize; i++) {
+    if (weak != nil && rememberedSet[i] == OopValue(weak))
+      evacuate(OT[rememberedSet[i]].cls); // the symbol table doesn't keep its strings alive
+    else
+      evacuateReferents(rememberedSet[i]);
+  }
+  forgetRemembered();
+  while (gcWorklistSize > 0)
+    evacuateReferents(gcWorklist[--gcWorklistSize]);
+  if (weak != nil) {
+    symbolTableSlots *_table = asSymbolTable(deref(internedStringsRef));
+    for (int idx = 0; idx < IntValue(numSlots(weak)); idx++) {
+      value_t s = slotAt(weak, Int(idx));
+      if (s == nil || !isOop(s) || !isYoung(OopValue(s)))
+        continue;
+      slotAtPut(weak, Int(idx), Tombstone);
+      _table->tally = Int(IntValue(_table->tally) - 1);
+    }
+  }
+  size_t numReclaimed = 0;
+  for (int w = 0; w < MaxWorkers; w++)
+    for (value_t *p = nurseryOf(w); p < nurseryTopOf(w); ) { // whatever is still in the nursery is garbage
+      int otIdx = *p++;
+      p += IntValue(OT[otIdx].numSlots);
+      if (isYoung(otIdx)) {
+        freeEntry(otIdx);
+        numReclaimed++;
+      }
+    }
+  emptyNurseries();
+  numOldRoots = numRoots;
+  flushMethodCache(); // reclaimed OT entries may be reused by other classes / selectors
+  gcCounts.minorGCs++;
+  gcCounts.reclaimed += numReclaimed;
+  recordPause(MinorGCPause, start);
+  dPrintf2("minor GC reclaimed %d OTEntries\n", numReclaimed);
+  return numReclaimed;
+}
+
+// A major collection marks, then sweeps lazily: mkIn() sweeps the OT a chunk at a time, as it runs out of free entries.
+// When incrementalGC is set (see the INCREMENTAL_GC environment variable), marking is interleaved w/ allocation, too. The
+// tri-color invariant (no marked object that has been scanned refers to an unmarked one) is maintained by writeBarrier,
+// which shades every reference that's stored while marking, and by allocating objects marked until the sweep is done.
+// ipb isn't written through the barrier, so it's shaded again at the end. gc() does a whole collection at once.
+
+const size_t SweepChunkSize = 1024, MarkStepSize = 2048, AllocsPerMarkStep = 256;
+int incrementalGC = 0;
+size_t sweepCursor, sweepLimit, allocsSinceMarkStep = 0;
+
+void regray(value_t oop) { // for when an object's slots have been overwritten w/o going through the barrier
+  if (gcPhase != Marking)
+    return;
+  else if (!marked[OopValue(oop)])
+    shade(oop);
+  else
+    gray(OopValue(oop));
+}
+
+void startMarking(void) {
   memset(marked, 0, OTSize);
-  int numMarked = mark(globals);
-  for (int i = 0; i < OTSize; i++) {
-    if (marked[i] || OT[i].numSlots == Int(-1))
+  markStackTop        = 0;
+  markStackOverflowed = 0;
+  value_t weakStrings = ::weakStrings();
+  if (weakStrings != nil)
+    marked[OopValue(weakStrings)] = Marked; // so that it won't be scanned
+  gcPhase = Marking;
+}
+
+size_t finishMarking(void) { // clears out the symbol table and the nursery, answers the number of OT entries reclaimed
+  value_t weakStrings = ::weakStrings();
+  if (weakStrings != nil) {
+    symbolTableSlots *_table = asSymbolTable(deref(internedStringsRef));
+    for (int idx = 0; idx < IntValue(numSlots(weakStrings)); idx++) {
+      value_t s = slotAt(weakStrings, Int(idx));
+      if (s == nil || !isOop(s) || marked[OopValue(s)])
+        continue;
+      slotAtPut(weakStrings, Int(idx), Tombstone);
+      _table->tally = Int(IntValue(_table->tally) - 1);
+    }
+  }
+  size_t numReclaimed = 0;
+  for (int w = 0; w < MaxWorkers; w++)
+    for (value_t *p = nurseryOf(w); p < nurseryTopOf(w); ) {
+      int otIdx = *p++;
+      p += IntValue(OT[otIdx].numSlots);
+      if (!isYoung(otIdx))
+        continue;
+      else if (marked[otIdx])
+        promote(otIdx);
+      else {
+        freeEntry(otIdx);
+        numReclaimed++;
+      }
+    }
+  emptyNurseries();
+  numOldRoots = numRoots;
+  forgetRemembered(); // all of the survivors are old now
+  flushMethodCache(); // reclaimed OT entries may be reused by other classes / selectors
+  gcCounts.majorGCs++;
+  gcCounts.reclaimed += numReclaimed;
+  sweepCursor = 0;
+  sweepLimit  = OTSize;
+  gcPhase     = Sweeping;
+  return numReclaimed;
+}
+
+void markStep(void) { // does a bounded amount of incremental marking
+  double start = now();
+  if (drainMarkStack(MarkStepSize)) {
+    shade(ipb);
+    drainMarkStack(SIZE_MAX);
+    finishMarking();
+  }
+  recordPause(MarkStepPause, start);
+}
+
+// In compacting mode (see the COMPACTING_GC environment variable), every major collection ends w/ compact(). It copies the
+// bodies of the old objects into a single block, in depth-first order from the roots, so that objects end up next to the
+// ones they refer to. Everything goes through the OT, so only the ptr.slots pointers change. The OT indices themselves
+// can't change (C code holds onto oops), so compact() rebuilds the free list in index order instead, which packs new
+// objects into the bottom of the OT, and trims the OT when the live objects fit in a much smaller one.
+
+int compactingGC = 0;
+
+void compact(void) {
+  double start = now();
+  int *order = NULL, *todo = NULL;
+  size_t numLive = 0, orderCapacity = 0, numTodo = 0, todoCapacity = 0, numWords = 1, top = 0;
+  memset(marked, 0, OTSize);
+  for (size_t r = 0; r < numAllRoots(); r++) {
+    value_t root = rootAt(r);
+    if (!isOop(root) || marked[OopValue(root)])
+      continue;
+    marked[OopValue(root)] = Marked;
+    pushIdx(todo, numTodo, todoCapacity, OopValue(root));
+    while (numTodo > 0) {
+      int otIdx = todo[--numTodo];
+      if (OT[otIdx].numSlots == Int(-1)) // (e.g., nil, early on in init())
+        continue;
+      pushIdx(order, numLive, orderCapacity, otIdx);
+      for (int i = numLiveSlots(otIdx) - 1; i >= 0; i--) { // so that slot 0 comes out first
+        value_t v = OT[otIdx].ptr.slots[i];
+        if (isOop(v) && !marked[OopValue(v)]) {
+          marked[OopValue(v)] = Marked;
+          pushIdx(todo, numTodo, todoCapacity, OopValue(v));
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < OTSize; i++) // whatever's left is only reachable through cls fields, or from the nursery
+    if (OT[i].numSlots != Int(-1) && !marked[i])
+      pushIdx(order, numLive, orderCapacity, i);
+  for (size_t n = 0; n < numLive; n++) {
+    if ((size_t)order[n] >= top)
+      top = order[n] + 1;
+    if (!isYoung(order[n]))
+      numWords += IntValue(OT[order[n]].numSlots);
+  }
+
+  value_t *block = allocate(numWords, value_t), *p = block; // (the extra word keeps empty bodies inside the block)
+  for (size_t n = 0; n < numLive; n++) {
+    OTEntry *e = &OT[order[n]];
+    if (isYoung(order[n]))
+      continue;
+    memcpy(p, e->ptr.slots, IntValue(e->numSlots) * sizeof(value_t));
+    if (ownsBody(e->ptr.slots))
+      freeBody(e->ptr.slots, IntValue(e->numSlots));
+    e->ptr.slots = p;
+    p += IntValue(e->numSlots);
+  }
+  free(compacted);
+  compacted    = block;
+  compactedEnd = block + numWords;
+  if (imageBodies != NULL) { // every old body has been moved out of the image
+    munmap(imageMapping, imageMappingSize);
+    imageBodies = imageEnd = NULL;
+  }
+  free(order);
+  free(todo);
+  releaseEmptySlabs();
+
+  size_t newOTSize = OTSize;
+  while (newOTSize / 2 >= OrigOTSize && newOTSize / 2 >= top && numLive * 4 <= newOTSize / 2)
+    newOTSize /= 2;
+  if (newOTSize < OTSize) {
+    dPrintf2("compact: trimming the OT to %d entries\n", (int)newOTSize);
+    OT          = (OTEntry *)realloc(OT, newOTSize * sizeof(OTEntry));
+    marked      = (byte_t *) realloc(marked, newOTSize);
+    remembered  = (byte_t *) realloc(remembered, newOTSize);
+    allocSiteOf = (int *)    realloc(allocSiteOf, newOTSize * sizeof(int));
+    jitInfo     = (int *)    realloc(jitInfo, newOTSize * sizeof(int));
+    OTSize      = newOTSize;
+  }
+  freeList       = NULL;
+  numFreeEntries = 0;
+  for (int i = OTSize - 1; i >= 0; i--)
+    if (OT[i].numSlots == Int(-1))
+      freeEntry(i);
+#ifdef __GLIBC__
+  malloc_trim(0); // give the memory that the old bodies were in back to the OS
+#endif
+  recordPause(CompactionPause, start);
+}
+
+void heapCensus(void);
+
+size_t sweep(size_t maxEntries) { // sweeps (at most) the next maxEntries OT entries, answers the number that it freed
+  double start = now();
+  size_t numFreed = 0, end = sweepLimit - sweepCursor > maxEntries ? sweepCursor + maxEntries : sweepLimit;
+  for (; sweepCursor < end; sweepCursor++)
+    if (OT[sweepCursor].numSlots == Int(-1))
       continue;
-    free(OT[i].ptr.slots);
-    OT[i].numSlots = Int(-1);
-    OT[i].cls      = nil;
-    OT[i].ptr.next = freeList;
-    freeList       = &OT[i];
+    else if (marked[sweepCursor])
+      gcCounts.marked++;
+    else { // (the young objects were taken care of already)
+      if (ownsBody(OT[sweepCursor].ptr.slots))
+        freeBody(OT[sweepCursor].ptr.slots, IntValue(OT[sweepCursor].numSlots));
+      freeEntry(sweepCursor);
+      numFreed++;
+    }
+  gcCounts.reclaimed += numFreed;
+  recordPause(SweepPause, start);
+  if (sweepCursor == sweepLimit) {
+    gcPhase = Idle;
+    releaseEmptySlabs();
+    if (compactingGC)
+      compact();
+    if (numFreeEntries < OTSize / 4)
+      growOT();
+    heapCensus();
   }
-  dPrintf2("GC reclaimed %d OTEntries\n", OTSize - numMarked);
-  return OTSize - numMarked;
+  return numFreed;
+}
+
+size_t gc(void) {
+  StopTheWorld;
+  double start = now();
+  startMarking();
+  markRoots();
+  size_t numReclaimed = finishMarking();
+  numReclaimed += sweep(SIZE_MAX);
+  recordPause(MajorGCPause, start);
+  dPrintf2("GC reclaimed %d OTEntries\n", numReclaimed);
+  return numReclaimed;
 }
 
-value_t mk(size_t numSlots) {
+void makeRoomFor(size_t numSlots, int tenured) { // does whatever GC work mkIn() has to do before it can allocate
+  StopTheWorld;
+  double start = now();
+  if (gcPhase == Marking && allocsSinceMarkStep >= AllocsPerMarkStep) {
+    allocsSinceMarkStep = 0;
+    markStep();
+  }
+  if (!tenured && nurseryTop + 1 + numSlots > nurseryEnd)
+    minorGC();
+  while (freeList == NULL && gcPhase == Sweeping)
+    sweep(SweepChunkSize);
   if (freeList == NULL || debug) {
-    gc();
+    if (debug)
+      gc();
+    else if (minorGC() < OTSize / 8 && gcPhase == Idle) { // only start a major collection if the young generation
+      double markStart = now();                           // didn't have enough garbage
+      startMarking();
+      if (incrementalGC && numWorkers == 1) { // (the write barrier doesn't shade atomically)
+        for (size_t r = 0; r < numAllRoots(); r++)
+          shade(rootAt(r));
+      }
+      else {
+        markRoots();
+        finishMarking();
+        recordPause(MajorGCPause, markStart);
+      }
+    }
+    while (freeList == NULL && gcPhase == Sweeping)
+      sweep(SweepChunkSize);
     if (freeList == NULL)
       growOT();
   }
-  OTEntry *newGuy = freeList;
-  freeList = freeList->ptr.next;
+  if (numWorkers > 1)
+    takeFreeEntries();
+  recordPause(AllocPause, start);
+}
+
+// The heap profiler (see the HEAP_PROFILE environment variable) records where about one in every heapSampleRate mk()s
+// happened: the allocating instruction and its callers, as a node in a calling-context tree whose frames are (code, ip,
+// fn) triples. Like the send profile, the tree is on the C side and doesn't keep its code alive, so a frame's code is only
+// identified by its OT index. The sampled objects are tallied by heapCensus(), at the end of every major collection.
+
+const int MaxSiteDepth = 32, DefaultHeapSampleRate = 64;
+
+typedef struct { value_t code, ip, fn; int parent; } allocSite; // fn is the frame's selector, Int(0) for a closure, or nil
+allocSite *allocSites; // node 0 is the root
+int       *allocSiteTable; // open addressing, on all four fields; 0 means empty, since the root is never in it
+size_t numAllocSites = 0, allocSitesCapacity = 0, allocSiteTableCapacity = 0, heapSampleRate = 0;
+__thread size_t heapSampleCountdown = 0;
+pthread_mutex_t profileLock = PTHREAD_MUTEX_INITIALIZER; // (for the tree, while several workers are running)
+
+int isBytecode(value_t code);
+
+int *allocSiteSlot(allocSite *s) { // answers s's slot in allocSiteTable, or the empty one for it
+  size_t mask = allocSiteTableCapacity - 1,
+         i    = ((((size_t)s->code * 31 + s->ip) * 31 + s->fn) * 31 + s->parent) & mask;
+  for (; allocSiteTable[i] != 0; i = (i + 1) & mask) {
+    allocSite *t = &allocSites[allocSiteTable[i]];
+    if (t->code == s->code && t->ip == s->ip && t->fn == s->fn && t->parent == s->parent)
+      break;
+  }
+  return &allocSiteTable[i];
+}
+
+int internAllocSite(value_t code, value_t ip, value_t fn, int parent) {
+  allocSite s = { code, ip, fn, parent };
+  if (2 * (numAllocSites + 1) > allocSiteTableCapacity) { // keep it at most half full
+    free(allocSiteTable);
+    allocSiteTableCapacity *= 2;
+    allocSiteTable          = allocate(allocSiteTableCapacity, int);
+    for (size_t n = 1; n < numAllocSites; n++)
+      *allocSiteSlot(&allocSites[n]) = n;
+  }
+  int *slot = allocSiteSlot(&s);
+  if (*slot == 0) {
+    if (numAllocSites == allocSitesCapacity) {
+      allocSitesCapacity *= 2;
+      allocSites          = (allocSite *)realloc(allocSites, allocSitesCapacity * sizeof(allocSite));
+    }
+    allocSites[numAllocSites] = s;
+    *slot = numAllocSites++;
+  }
+  return *slot;
+}
+
+void setHeapSampleRate(size_t rate) { // 0 turns sampling off
+  if (rate > 0 && allocSites == NULL) {
+    allocSitesCapacity     = 256;
+    allocSites             = allocate(allocSitesCapacity, allocSite);
+    numAllocSites          = 1;
+    allocSiteTableCapacity = 2 * allocSitesCapacity;
+    allocSiteTable         = allocate(allocSiteTableCapacity, int);
+  }
+  heapSampleRate      = rate;
+  heapSampleCountdown = rate > 0 ? 1 + random() % (2 * rate - 1) : 0; // randomized, so that it doesn't alias w/ loops
+}
+
+int isCallFrame(int f) { // whether the frame at f has a caller's ip, ipb, and fp under it (see PrepCall)
+  if (f - 4 < ContextHeaderSlots || f >= IntValue(numSlots(stack)))
+    return 0;
+  value_t oldFp = slotAt(stack, Int(f - 2)), oldIpb = slotAt(stack, Int(f - 3)), oldIp = slotAt(stack, Int(f - 4));
+  return isInt(oldFp) && IntValue(oldFp) >= ContextHeaderSlots && IntValue(oldFp) < f && isInt(oldIp) && isOop(oldIpb) &&
+         oldIpb != nil && (size_t)OopValue(oldIpb) < OTSize && OT[OopValue(oldIpb)].numSlots != Int(-1) && isBytecode(oldIpb);
+}
+
+int sampleAllocSite(void) { // answers the node for the current instruction and its callers
+  value_t codes[MaxSiteDepth], ips[MaxSiteDepth], fns[MaxSiteDepth], code = ipb, i = ip;
+  int     n = 0, f = isInt(fp) ? IntValue(fp) : 0, site = 0; // (fp is nil early on in init())
+  setHeapSampleRate(heapSampleRate);
+  for (; n < MaxSiteDepth && isOop(code) && code != nil; n++) {
+    codes[n] = code;
+    ips[n]   = i;
+    fns[n]   = nil;
+    if (!isCallFrame(f)) {
+      n++;
+      break;
+    }
+    fns[n] = slotAt(stack, Int(f));
+    if (!isOop(fns[n]) || classOf(fns[n]) != Str)
+      fns[n] = Int(0); // a closure: its code already says which one it is, and closures come and go
+    code   = slotAt(stack, Int(f - 3));
+    i      = slotAt(stack, Int(f - 4));
+    f      = IntValue(slotAt(stack, Int(f - 2)));
+  }
+  lockShared(&profileLock);
+  while (n > 0) {
+    n--;
+    site = internAllocSite(codes[n], ips[n], fns[n], site);
+  }
+  if (site == 0)
+    site = internAllocSite(nil, Int(-1), nil, 0); // i.e., the VM itself (e.g., init())
+  unlockShared(&profileLock);
+  return site;
+}
+
+value_t mkIn(size_t numSlots, int tenured) {
+  if (safepointRequested())
+    safepoint();
+  int site = heapSampleRate > 0 && --heapSampleCountdown == 0 ? sampleAllocSite() : 0;
+  tenured = tenured || numSlots > MaxYoungSlots;
+  int sizeClass = numSlots <= MaxSlabSlots ? sizeClassOf[numSlots] : LargeObjects;
+  mkCounts[sizeClass]++;
+  mkWords[sizeClass] += numSlots;
+  OTEntry **entries = numWorkers > 1 ? &localFreeList : &freeList;
+  if (*entries == NULL && entries == &localFreeList)
+    takeFreeEntries();
+  if ((!tenured && nurseryTop + 1 + numSlots > nurseryEnd) || *entries == NULL || debug ||
+      (gcPhase == Marking && ++allocsSinceMarkStep >= AllocsPerMarkStep))
+    makeRoomFor(numSlots, tenured);
+  OTEntry *newGuy = *entries;
+  int      otIdx  = newGuy - OT;
+  *entries = newGuy->ptr.next;
+  if (entries == &freeList)
+    numFreeEntries--;
+  else
+    numLocalFreeEntries--;
+  if (gcPhase != Idle)
+    marked[otIdx] = Marked; // objects are allocated black during a major collection
   newGuy->numSlots  = Int(numSlots);
   newGuy->cls       = Obj;
-  newGuy->ptr.slots = allocate(numSlots, value_t);
   newGuy->isBinary  = 0;
-  return Oop(newGuy - OT);
+  newGuy->isContext = 0;
+  allocSiteOf[otIdx] = site;
+  jitInfo[otIdx]     = 0;
+  if (tenured) {
+    lockShared(&heapLock);
+    newGuy->ptr.slots = allocBody(numSlots);
+    unlockShared(&heapLock);
+    memset(newGuy->ptr.slots, 0, numSlots * sizeof(value_t));
+    writeBarrier(otIdx, Obj);
+  }
+  else {
+    *nurseryTop = otIdx; // the header word
+    newGuy->ptr.slots = nurseryTop + 1;
+    memset(newGuy->ptr.slots, 0, numSlots * sizeof(value_t));
+    nurseryTop += 1 + numSlots;
+  }
+  return Oop(otIdx);
 }
 
+value_t mk(size_t numSlots)             { return mkIn(numSlots, 0); }
+value_t mkTenured(size_t numSlots)      { return mkIn(numSlots, 1); }
+
 value_t mkBinary(size_t numWords) {
   value_t r = mk(numWords);
   OT[OopValue(r)].isBinary = 1;
   return r;
 }
 
-const size_t MaxNumPrims = 64;
+value_t mkStr(const char *bytes, size_t length) { // (bytes may be NULL, for a string of 0s)
+  value_t r = mkBinary(sizeof(strSlots) / sizeof(value_t) + ((length + 8) & ~7) / sizeof(value_t));
+  strSlots *_r = asStr(r);
+  _r->length = Int(length);
+  if (bytes != NULL)
+    memcpy(_r->bytes, bytes, length);
+  classOf_(r, Str);
+  return r;
+}
+
+value_t mkSendCache(value_t nArgs) {
+  value_t r = mk(sizeof(sendCacheSlots) / sizeof(value_t));
+  sendCacheSlots *sc = asSendCache(r);
+  sc->nArgs      = nArgs;
+  sc->epoch      = Int(0); // i.e., stale
+  sc->numEntries = Int(0);
+  sc->intSends   = Int(0);
+  return r;
+}
+
+value_t sendOperand(value_t prim, value_t operand); // (see bytecode)
+
+const size_t MaxNumPrims = 128; // (opWord has room for 256)
 value_t (*prims[MaxNumPrims])(value_t);
 void *primNames[MaxNumPrims];
 size_t numPrims = 0;
@@ -197,33 +1462,52 @@ value_t store(value_t offset, value_t v)              { return slotAtPut(stack,
 value_t load (value_t offset)                         { return slotAt   (stack, Int(IntValue(fp) - IntValue(offset)));    }
 
 value_t fsend1(value_t sel, value_t ecv);
+value_t interp(value_t prog, value_t retFp = Int(-1));
+#define Resume                            Int(0) // as interp()'s prog: carry on w/ the current thread after ip
 
-void vprintf2(const char *fmt, va_list args, value_t n) {
-  int oldDebug = debug; debug = 0;
-  while (1)
-    switch (*fmt) { case 0:   va_end(args); debug = oldDebug; return;
+// Code arrays start out as arrays of (prim . operand) cons cells, and get assembled (lazily, see bytecode) into a dense
+// format w/ two words per instruction: an op word, which holds the primitive's index in its low 8 bits and the offset of
+// its handler in interp() in the rest, and the operand itself. Both are ordinary values, so the GC needs no special
+// treatment for bytecode (op words are tagged as integers).
+
+#define opWord(prim, handlerOffset)       Int((handlerOffset) * 256 + IntValue(prim))
+#define opPrim(w)                         Int(IntValue(w) & 0xFF)
+#define opHandlerOffset(w)                ((w) >> 9)
+
+int handlerOffsets[MaxNumPrims]; // filled in by interp(nil)
+__thread size_t primCounts[MaxNumPrims];  // the number of times interp() has executed each primitive
+
+int isBytecode(value_t code)            { return IntValue(numSlots(code)) > 0 && isInt(slots(code)[0]); } // code arrays are never empty
+
+void vprintf2(const char *fmt, va_list args, value_t n) { // (the literal text between directives is written in bulk)
+  while (1) {
+    const char *pct = strchrnul(fmt, '%');
+    outWrite(fmt, pct - fmt);
+    fmt = pct;
+    switch (*fmt) { case 0:   va_end(args); return;
                     case '%': fmt++;
-                              switch (*fmt++) { case '%': putchar('%');                                                  break;
-                                                case 'o': fsend1(sPrint, va_arg(args, value_t));                         break;
-                                                case 'd': printf("%d", va_arg(args, int));                               break;
+                              switch (*fmt++) { case '%': outChar('%');                                                  break;
+                                                case 'o': { int oldDebug = debug; debug = 0;
+                                                            printValue(va_arg(args, value_t));
+                                                            debug = oldDebug; }                                          break;
+                                                case 'd': outInt(va_arg(args, int));                                     break;
                                                 case 'S': printf2("ipb(ip=%o): [", ip);
-                                                          for (int idx = 0; idx < IntValue(numSlots(ipb)); idx++) {
+                                                          for (int idx = 0; idx < IntValue(numSlots(ipb)) / 2; idx++) {
                                                             if (idx > 0) printf2(", ");
-                                                            value_t instr = slotAt(ipb, Int(idx)),
-                                                                    prim  = slotAt(instr, Int(0)),
-                                                                    arg   = slotAt(instr, Int(1));
+                                                            value_t prim  = opPrim(slotAt(ipb, Int(2 * idx))),
+                                                                    arg   = slotAt(ipb, Int(2 * idx + 1));
                                                             if (idx == IntValue(ip)) printf2("<<");
                                                             printf2("%o(%o)", primNames[IntValue(prim)], arg);
                                                             if (idx == IntValue(ip)) printf2(">>");
                                                           }
                                                           printf2("]\nfp: %o\n", fp);
                                                           printf2("/---------------------------------------------\\\n");
-                                                          for (int spv = IntValue(sp); spv >= 0; spv--)
+                                                          for (int spv = IntValue(sp); spv >= ContextHeaderSlots; spv--)
                                                             printf2("  %o\n", slotAt(stack, Int(spv)));
                                                           printf2("\\---------------------------------------------/\n"); break;
-                                                default:  putchar('%'); fmt--; };
-                              break;
-                    default:  putchar(*fmt++); }
+                                                default:  outChar('%'); fmt--; };
+                              break; }
+  }
 }
 
 #define Prim(Name, Arg, Body)                value_t p##Name(value_t Arg) { Body; return nil; } \
@@ -236,22 +1520,48 @@ void vprintf2(const char *fmt, va_list args, value_t n) {
 #define _p3(Name, Arg1, Arg2, Arg3)       ({ _p1(Push, Arg3); _p2(Name, Arg1, Arg2);                                              })
 #define _p4(Name, Arg1, Arg2, Arg3, Arg4) ({ _p1(Push, Arg4); _p3(Name, Arg1, Arg2, Arg3);                                        })
 
-#define PushArg(x)                        ({ _p1(Push, x); _p1(Box, Int(0));                                                      })
-#define PrepSend(sel, recv)               ({ _p(PrepCall); _p1(Push, sel); _p1(Push, recv); _p1(Box, Int(1)); _p1(Box, Int(0));   \
-                                                                                                                              fp; })
-#define DoSend(n, retFp)                  ({ _p1(Send, Int(n)); interp(ipb, retFp);                                               })
+#define PushArg(x)                          _p1(Push, x)
+#define PrepSend(sel, recv)               ({ _p(PrepCall); _p1(Push, sel); _p1(Push, recv); fp;                                   })
+#define SendSite(n)                       ({ static value_t _sc = nil; if (_sc == nil) _sc = addGlobal(mkSendCache(Int(n))); _sc; })
+#define DoSend(n, retFp)                  ({ _p1(Send, SendSite(n)); interp(ipb, retFp);                                          })
 
 #define send1(sel, recv)                  ({ value_t retFp = PrepSend(sel, recv);                               DoSend(1, retFp); })
 #define send2(sel, recv, arg1)            ({ value_t retFp = PrepSend(sel, recv); PushArg(arg1);                DoSend(2, retFp); })
 #define send3(sel, recv, arg1, arg2)      ({ value_t retFp = PrepSend(sel, recv); PushArg(arg1); PushArg(arg2); DoSend(3, retFp); })
 
+// A context's stack starts out small, and Push makes it twice as big whenever it's full. That happens in place: the context
+// keeps its OT entry and gets a new body (it's old, so the new body is, too), and native code re-reads the address of the
+// stack's slots after every primitive that it calls, see jitCallPrim.
+value_t mkContext(void) {
+  value_t ctx = mkTenured(ContextHeaderSlots + InitialStackSize);
+  OT[OopValue(ctx)].isContext = 1;
+  return ctx;
+}
+
+void growStack(void) {
+  OTEntry *e = &OT[OopValue(stack)];
+  size_t   n = IntValue(e->numSlots), newN = ContextHeaderSlots + 2 * (n - ContextHeaderSlots);
+  if (newN - ContextHeaderSlots > MaxStackSize)
+    error("stack overflow");
+  lockShared(&heapLock);
+  value_t *body = allocBody(newN);
+  memcpy(body, e->ptr.slots, n * sizeof(value_t));
+  memset(body + n, 0, (newN - n) * sizeof(value_t));
+  if (ownsBody(e->ptr.slots))
+    freeBody(e->ptr.slots, n);
+  unlockShared(&heapLock);
+  e->ptr.slots = body;
+  e->numSlots  = Int(newN);
+}
+
 Prim(Push, v,          { value_t _v = v;
+                         if (sp == numSlots(stack))
+                           growStack();
                          slotAtPut(stack, sp, _v);
                          sp = Int(IntValue(sp) + 1);
-                         dAssert(sp < numSlots(stack));
                          return _v; })
 
-Prim(Pop, _,           { dAssert(sp > Int(0));
+Prim(Pop, _,           { dAssert(sp > Int(ContextHeaderSlots));
                          sp = Int(IntValue(sp) - 1);
                          value_t r = slotAt(stack, sp);
                          slotAtPut(stack, sp, nil);     // clear the slot to prevent memory leak
@@ -259,9 +1569,21 @@ Prim(Pop, _,           { dAssert(sp > Int(0));
 
 Prim(Eq, _,            { return _p1(Push, Int(IntValue(_p(Pop)) == IntValue(_p(Pop))));                                      })
 
-Prim(Add, _,           { value_t op2 = _p(Pop); return _p1(Push, Int(IntValue(_p(Pop)) + IntValue(op2)));                    })
-Prim(Sub, _,           { value_t op2 = _p(Pop); return _p1(Push, Int(IntValue(_p(Pop)) - IntValue(op2)));                    })
-Prim(Mul, _,           { value_t op2 = _p(Pop); return _p1(Push, Int(IntValue(_p(Pop)) * IntValue(op2)));                    })
+// Int arithmetic is checked: a result that doesn't fit in an Int (see fitsInt) is an error rather than a wrong answer
+#define IntArith(Op, a, b)                ({ value_t _r;                                                                     \
+                                             if (__builtin_##Op##_overflow(IntValue(a), IntValue(b), &_r) || !fitsInt(_r))   \
+                                               error("integer overflow");                                                    \
+                                             Int(_r); })
+
+Prim(Add, _,           { value_t op2 = _p(Pop); return _p1(Push, IntArith(add, _p(Pop), op2));                               })
+Prim(Sub, _,           { value_t op2 = _p(Pop); return _p1(Push, IntArith(sub, _p(Pop), op2));                               })
+Prim(Mul, _,           { value_t op2 = _p(Pop); return _p1(Push, IntArith(mul, _p(Pop), op2));                               })
+
+// superinstructions (see the peephole pass in compiler.ojs): Push k; Add  and  Push k; Sub, on the top of the stack in place
+Prim(AddI, k,          { value_t i = Int(IntValue(sp) - 1);
+                         return slotAtPut(stack, i, IntArith(add, slotAt(stack, i), k));                                     })
+Prim(SubI, k,          { value_t i = Int(IntValue(sp) - 1);
+                         return slotAtPut(stack, i, IntArith(sub, slotAt(stack, i), k));                                     })
 
 Prim(Box,   offset,    { value_t i = Int(IntValue(sp) - 1 - IntValue(offset)); slotAtPut(stack, i,   ref(slotAt(stack, i))); })
 Prim(Unbox, offset,    { value_t i = Int(IntValue(sp) - 1 - IntValue(offset)); slotAtPut(stack, i, deref(slotAt(stack, i))); })
@@ -270,8 +1592,7 @@ Prim(Ld, offset,       { return _p1(Push, slotAt   (stack, Int(IntValue(fp) - In
 Prim(St, offset,       { return           slotAtPut(stack, Int(IntValue(fp) - IntValue(offset)), _p(Pop));                   })
 
 Prim(Arg, n,           { return _p1(Push, load(Int(-IntValue(n)))); })
-Prim(Fv, n,            { value_t closure = slotAt(load(Int(0)), Int(0));
-                         return _p1(Push, slotAt(closure, Int(IntValue(n) + 1))); })
+Prim(Fv, n,            { return _p1(Push, slotAt(load(Int(0)), Int(IntValue(n) + 1))); })
 
 Prim(StVar, _,         { value_t val = _p(Pop);
                          return deref_(_p(Pop), val); })
@@ -281,13 +1602,66 @@ Prim(MkFun, nFreeVars, { value_t closure = mk(IntValue(nFreeVars) + 1);
                            slotAtPut(closure, Int(i), _p(Pop));
                          return _p1(Push, closure); })
 
+// answers a closure w/o free variables for code, allocated once and for all: the peephole pass in compiler.ojs turns
+// Push code; MkFun 0 into Push constClosure(code), so a lambda that captures nothing costs no allocation when it's evaluated
+value_t constClosure(value_t code) {
+  value_t closure = addGlobal(mkTenured(1));
+  slotAtPut(closure, Int(0), code);
+  return closure;
+}
+
 Prim(PrepCall, _,      { _p1(Push, nil); // make room for ip
                          _p1(Push, ipb);
                          _p1(Push, fp);
                          _p1(Push, nil); // make room for nArgs
                          return nil; })
 
-Prim(Call, nArgs,      { ipb = deref(slotAt(slotAt(stack, Int(IntValue(sp) - 1 - IntValue(nArgs))), Int(0))); // unbox fn & get code
+// swaps the bodies of a and b (everything goes through the OT, so there's nothing else to update)
+void become(value_t a, value_t b) {
+  OTEntry *ea = &OT[OopValue(a)], *eb = &OT[OopValue(b)], tmp = *ea;
+  ea->numSlots = eb->numSlots; ea->isBinary = eb->isBinary; ea->isContext = eb->isContext; ea->ptr = eb->ptr;
+  eb->numSlots = tmp.numSlots; eb->isBinary = tmp.isBinary; eb->isContext = tmp.isContext; eb->ptr = tmp.ptr;
+  int info = jitInfo[OopValue(a)];                            // native code goes w/ the body it was compiled from
+  jitInfo[OopValue(a)] = jitInfo[OopValue(b)];
+  jitInfo[OopValue(b)] = info;
+  if (isYoung(OopValue(a))) ea->ptr.slots[-1] = OopValue(a); // fix up the nursery headers
+  if (isYoung(OopValue(b))) eb->ptr.slots[-1] = OopValue(b);
+  rememberOld(OopValue(a));                                   // the write barrier may have attributed their young
+  rememberOld(OopValue(b));                                   // references to each other
+  regray(a);
+  regray(b);
+}
+
+void jitDrop(value_t impl) { // a replaced method's code is interpreted from then on (see the JIT, below)
+  if (isOop(impl) && impl != nil && numSlots(impl) > Int(0) && isOop(slotAt(impl, Int(0))) && slotAt(impl, Int(0)) != nil)
+    jitInfo[OopValue(slotAt(impl, Int(0)))] = JitNever;
+}
+
+// assembles a code array in place (if it isn't bytecode already), so every closure that shares it sees the bytecode
+value_t bytecode(value_t code) {
+  if (isBytecode(code))
+    return code;
+  if (handlerOffsets[0] == 0)
+    interp(nil);
+  HandleScope;
+  handle(code);
+  StopTheWorld; // (other workers may be running code that shares it)
+  if (isBytecode(code))
+    return code; // (one of them got there first)
+  int     n  = IntValue(numSlots(code));
+  value_t bc = handle(mkTenured(2 * n)); // code tends to stick around
+  for (int idx = 0; idx < n; idx++) {
+    value_t instr = slotAt(code, Int(idx)), prim = car(instr);
+    if (!isInt(prim) || IntValue(prim) < 0 || (size_t)IntValue(prim) >= numPrims)
+      error("%d is not a valid primitive\n", (int)IntValue(prim));
+    slotAtPut(bc, Int(2 * idx),     opWord(prim, handlerOffsets[IntValue(prim)]));
+    slotAtPut(bc, Int(2 * idx + 1), sendOperand(prim, cdr(instr)));
+  }
+  become(code, bc);
+  return code;
+}
+
+Prim(Call, nArgs,      { ipb = bytecode(slotAt(slotAt(stack, Int(IntValue(sp) - 1 - IntValue(nArgs))), Int(0))); // get fn's code
                          fp  = Int(IntValue(sp) - IntValue(nArgs) - 1);
                          store(Int(1), nArgs);
                          store(Int(4), ip);
@@ -296,7 +1670,7 @@ Prim(Call, nArgs,      { ipb = deref(slotAt(slotAt(stack, Int(IntValue(sp) - 1 -
 
 Prim(TCall, newNArgs,  { for (int i = IntValue(newNArgs); i >= 0; i--)
                            store(Int(-i), _p(Pop));
-                         ipb = slotAt(deref(load(Int(0))), Int(0));
+                         ipb = bytecode(slotAt(load(Int(0)), Int(0)));
                          ip  = Int(-1);
                          sp  = Int(IntValue(fp) + IntValue(newNArgs) + 1);
                          return nil; })
@@ -308,158 +1682,1060 @@ Prim(Ret, _,           { value_t r = _p(Pop);
                          ip  = _p(Pop);
                          return _p1(Push, r); })
 
-PMeth(InstMeth,        { value_t sel      = _p(Pop);
-                         value_t impl     = _p(Pop);
-                         classSlots *_cls = asClass(recv);
-                         int freeIdx = -1;
-                         for (int idx = 0; idx < IntValue(_cls->vTableSize); idx++) {
-                           value_t s = slotAt(_cls->sels, Int(idx));
-                           if      (s == sel) return slotAtPut(_cls->impls, Int(idx), impl);
-                           else if (s == nil) freeIdx = idx;
-                         }
-                         if (freeIdx >= 0) {        slotAtPut(_cls->sels,  Int(freeIdx), sel);
-                                             return slotAtPut(_cls->impls, Int(freeIdx), impl); }
-                         int oldVTSize = IntValue(_cls->vTableSize);
-                         int newVTSize = oldVTSize * 2;
-                         _cls->vTableSize = Int(newVTSize);
-                         value_t m;
-                         m = mk(newVTSize); memcpy(slots(m), slots(_cls->sels),  newVTSize * sizeof(value_t)); _cls->sels  = m;
-                         m = mk(newVTSize); memcpy(slots(m), slots(_cls->impls), newVTSize * sizeof(value_t)); _cls->impls = m;
-                                slotAtPut(_cls->sels,  Int(oldVTSize), sel);
-                         return slotAtPut(_cls->impls, Int(oldVTSize), impl); })
+// Method tables: a class's sels, impls, and definers are an open-addressing hash table (keyed on the selector, which is
+// interned) of every method that its instances understand, inherited ones included, so Lookup is a single probe sequence
+// however deep the hierarchy is. definers says which class each method comes from (by its identity hash, so a class can
+// be printed w/o going around in circles, like classesRef does below). The tables are kept at most half full,
+// and are updated incrementally: InstMeth copies a method down to the subclasses that don't override it, and ClassInit
+// rebuilds the class's table from its superclass's, then those of its subclasses, which are found in classesRef (a list
+// of every class).
+
+#define selHash(sel)                      (((uint32_t)(sel) >> 1) * 2654435761u)
+
+int methodIdx(value_t cls, value_t sel) { // answers the index of sel in cls's table, or that of the empty slot for it
+  classSlots *_cls = asClass(cls);
+  value_t    *sels = slots(_cls->sels);
+  int         mask = IntValue(_cls->vTableSize) - 1, i = selHash(sel) & mask;
+  while (sels[i] != nil && sels[i] != sel)
+    i = (i + 1) & mask;
+  return i;
+}
 
-PMeth(ObjGetSet,       { value_t nArgs = load(Int(1)); // the number of arguments passed to the method, not the primitive
-                         value_t idx   = _p(Pop);
-                         switch (IntValue(nArgs)) {
-                           case 1:  return slotAt   (recv, idx);
-                           case 2:  return slotAtPut(recv, idx, deref(load(Int(-2))));
-                           default: error("getter/setter called with %o arguments (must be 1 or 2)", nArgs);
-                         } })
+void newMethodTable(value_t cls, int capacity) { // (capacity must be a power of 2)
+  value_t m;
+  m = mk(capacity); fieldAtPut(cls, classSlots, sels,     m);
+  m = mk(capacity); fieldAtPut(cls, classSlots, impls,    m);
+  m = mk(capacity); fieldAtPut(cls, classSlots, definers, m);
+  asClass(cls)->vTableSize = Int(capacity);
+  asClass(cls)->numMethods = Int(0);
+}
 
-PMeth(StrGetSet,       { value_t nArgs = load(Int(1)); // the number of arguments passed to the method, not the primitive
-                         value_t idx   = _p(Pop);
-                         switch (IntValue(nArgs)) {
-                           case 1:  return slotAt   (recv, idx);
-                           default: error("a string's setter was called, but strings are immutable");
-                         } })
+void putMethod(value_t cls, value_t sel, value_t impl, value_t definer); // (sel and impl must be reachable)
 
-Prim(DoPrim, n,        { value_t prim = _p(Pop);
-                         value_t arg1 = n > Int(0) ? _p(Pop) : nil;
-                         return _p1(Push, _p1(prim, arg1)); })
+void rehashMethods(value_t cls, int capacity, value_t keepDefiner) { // keeps everything (nil) or only keepDefiner's methods
+  HandleScope;
+  classSlots *_cls = asClass(cls);
+  value_t sels = handle(_cls->sels), impls = handle(_cls->impls), definers = handle(_cls->definers);
+  newMethodTable(cls, capacity);
+  for (int i = 0; sels != nil && i < IntValue(numSlots(sels)); i++)
+    if (slotAt(sels, Int(i)) != nil && (keepDefiner == nil || slotAt(definers, Int(i)) == keepDefiner))
+      putMethod(cls, slotAt(sels, Int(i)), slotAt(impls, Int(i)), slotAt(definers, Int(i)));
+}
+
+void putMethod(value_t cls, value_t sel, value_t impl, value_t definer) {
+  if (2 * (IntValue(asClass(cls)->numMethods) + 1) > IntValue(asClass(cls)->vTableSize))
+    rehashMethods(cls, 2 * IntValue(asClass(cls)->vTableSize), nil);
+  classSlots *_cls = asClass(cls);
+  int i = methodIdx(cls, sel);
+  if (slotAt(_cls->sels, Int(i)) == nil) {
+    slotAtPut(_cls->sels, Int(i), sel);
+    _cls->numMethods = Int(IntValue(_cls->numMethods) + 1);
+  }
+  slotAtPut(_cls->impls,    Int(i), impl);
+  slotAtPut(_cls->definers, Int(i), definer);
+}
+
+void copyDown(value_t cls, value_t sel, value_t impl, value_t definer) { // to the subclasses that don't override sel
+  for (value_t classes = deref(classesRef); classes != nil; classes = cdr(classes)) {
+    value_t sub = car(classes);
+    if (asClass(sub)->super != cls)
+      continue;
+    int i = methodIdx(sub, sel);
+    if (slotAt(asClass(sub)->sels, Int(i)) != sel || slotAt(asClass(sub)->definers, Int(i)) != Int(sub)) {
+      putMethod(sub, sel, impl, definer);
+      copyDown(sub, sel, impl, definer);
+    }
+  }
+}
+
+void inheritMethods(value_t cls) { // rebuilds cls's table (keeping its own methods), then those of its subclasses
+  value_t super  = asClass(cls)->super;
+  int     needed = (asClass(cls)->sels != nil ? IntValue(asClass(cls)->numMethods) : 0) + // (nil before the first ClassInit)
+                   (super != nil ? IntValue(asClass(super)->numMethods) : 0), cap = 16;
+  while (cap < 2 * (needed + 1))
+    cap *= 2;
+  rehashMethods(cls, cap, Int(cls)); // (w/ a nil table, that's an empty one)
+  for (int i = 0; super != nil && i < IntValue(asClass(super)->vTableSize); i++) {
+    value_t sel = slotAt(asClass(super)->sels, Int(i));
+    if (sel == nil)
+      continue;
+    int j = methodIdx(cls, sel);
+    if (slotAt(asClass(cls)->sels, Int(j)) != sel) // cls's own methods override inherited ones
+      putMethod(cls, sel, slotAt(asClass(super)->impls, Int(i)), slotAt(asClass(super)->definers, Int(i)));
+  }
+  for (value_t classes = deref(classesRef); classes != nil; classes = cdr(classes))
+    if (asClass(car(classes))->super == cls)
+      inheritMethods(car(classes));
+}
+
+PMeth(InstMeth,        { HandleScope;
+                         handle(recv);
+                         StopTheWorld; // (the other workers look methods up w/o locking)
+                         value_t sel  = handle(_p(Pop)); // keep impl and sel alive while the tables grow
+                         value_t impl = handle(_p(Pop));
+                         invalidateSendCaches();
+                         int i = methodIdx(recv, sel);
+                         if (slotAt(asClass(recv)->sels, Int(i)) == sel && slotAt(asClass(recv)->definers, Int(i)) == Int(recv))
+                           jitDrop(slotAt(asClass(recv)->impls, Int(i)));
+                         putMethod(recv, sel, impl, Int(recv));
+                         copyDown(recv, sel, impl, Int(recv));
+                         return impl; })
+
+PMeth(ObjGetSet,       { value_t nArgs = load(Int(1)); // the number of arguments passed to the method, not the primitive
+                         value_t idx   = _p(Pop);
+                         switch (IntValue(nArgs)) {
+                           case 1:  return slotAt   (recv, idx);
+                           case 2:  return slotAtPut(recv, idx, load(Int(-2)));
+                           default: error("getter/setter called with %o arguments (must be 1 or 2)", nArgs);
+                         } })
+
+PMeth(StrGetSet,       { value_t nArgs = load(Int(1)); // the number of arguments passed to the method, not the primitive
+                         value_t idx   = _p(Pop);
+                         dAssert(0 <= IntValue(idx) && IntValue(idx) < IntValue(asStr(recv)->length));
+                         switch (IntValue(nArgs)) {
+                           case 1:  return Int(asStr(recv)->bytes[IntValue(idx)]);
+                           default: error("a string's setter was called, but strings are immutable");
+                         } })
+
+Prim(DoPrim, n,        { value_t prim = _p(Pop);
+                         value_t arg1 = n > Int(0) ? _p(Pop) : nil;
+                         return _p1(Push, _p1(prim, arg1)); })
 
 PMeth(InstGetSet,      { value_t name     = _p(Pop);
                          value_t idx      = _p(Pop);
-                         classSlots *_cls = asClass(recv);
-                                            slotAtPut(_cls->sels,  idx, name);
-                         value_t closure  = slotAtPut(_cls->impls, idx, ref(nil));
-                         value_t code     = deref_(closure, mk(6));
+                         HandleScope;
+                         handle(name);
+                         value_t closure  = handle(ref(nil));
+                         value_t code     = deref_(closure, mk(5));
                          slotAtPut(code, Int(0), cons(Push,   idx));
-                         slotAtPut(code, Int(1), cons(Arg,    Int(1)));    // push boxed receiver
-                         slotAtPut(code, Int(2), cons(Unbox,  Int(0)));    // unbox the receiver on the stack
-                         slotAtPut(code, Int(3), cons(Push,   ObjGetSet)); // push the primitive
-                         slotAtPut(code, Int(4), cons(DoPrim, Int(2)));
-                         slotAtPut(code, Int(5), cons(Ret,    nil));       // return (DoPrim's result is top of stack)
-                       })
+                         slotAtPut(code, Int(1), cons(Arg,    Int(1)));    // push the receiver
+                         slotAtPut(code, Int(2), cons(Push,   ObjGetSet)); // push the primitive
+                         slotAtPut(code, Int(3), cons(DoPrim, Int(2)));
+                         slotAtPut(code, Int(4), cons(Ret,    nil));       // return (DoPrim's result is top of stack)
+                         return _p3(InstMeth, recv, name, closure); })
 
 PMeth(MkObj,           { value_t nAddlSlots = _p(Pop);
+                         if (recv != nil && recv == Str) // strings are binary (see strSlots)
+                           return mkStr(NULL, IntValue(nAddlSlots));
                          value_t obj        = mk((recv == nil ? 0 : IntValue(asClass(recv)->numSlots)) + IntValue(nAddlSlots));
                          classOf_(obj, recv);
                          return obj; })
 
-PMeth(ClassInit,       { classSlots *_cls  = asClass(recv);
-                         _cls->name        = _p(Pop);
-                         _cls->super       = _p(Pop);
-                         _cls->slotNames   = _p(Pop);
+PMeth(ClassInit,       { HandleScope;
+                         handle(recv);
+                         StopTheWorld;
+                         classSlots *_cls  = asClass(recv);
+                         int         isNew = _cls->vTableSize == nil;
+                         invalidateSendCaches();
+                         fieldAtPut(recv, classSlots, name,      _p(Pop));
+                         fieldAtPut(recv, classSlots, super,     _p(Pop));
+                         fieldAtPut(recv, classSlots, slotNames, _p(Pop));
                          _cls->numSlots    = Int(IntValue(numSlots(_cls->slotNames)) +
                                                  IntValue(_cls->super == nil ? Int(0) : asClass(_cls->super)->numSlots));
-                         _cls->vTableSize  = Int(16);
-                         _cls->sels        = mk(IntValue(_cls->vTableSize));
-                         _cls->impls       = mk(IntValue(_cls->vTableSize));
-                         for (value_t idx = Int(0); idx < numSlots(_cls->slotNames); idx = Int(IntValue(idx) + 1))
-                           _p3(InstGetSet, recv, slotAt(_cls->slotNames, idx), idx);
+                         if (isNew)
+                           deref_(classesRef, cons(recv, deref(classesRef)));
+                         fieldAtPut(recv, classSlots, sels, nil); // forget recv's own methods (but not its subclasses')
+                         inheritMethods(recv);
+                         for (value_t idx = Int(0); idx < numSlots(asClass(recv)->slotNames); idx = Int(IntValue(idx) + 1))
+                           _p3(InstGetSet, recv, slotAt(asClass(recv)->slotNames, idx), idx);
                          return recv; })
 
-Prim(MkClass, name,    { value_t cls       = addGlobal(Class != nil ? _p2(MkObj, Class, Int(0))
+Prim(MkClass, name,    { HandleScope;
+                         handle(name);
+                         StopTheWorld;
+                         value_t cls       = addGlobal(Class != nil ? _p2(MkObj, Class, Int(0))
                                                                     : mk(sizeof(classSlots) / sizeof(value_t)));
                          value_t super     = _p(Pop);
                          value_t slotNames = _p(Pop);
                          return _p4(ClassInit, cls, name, super, slotNames); })
 
-Prim(Lookup, _,        { // note: the method cache will be implemented in "userland" (where this primitive will be replaced)
-                         value_t recv = deref(load(Int(-1)));                            // unbox arg(1)
-                         value_t sel  = deref(load(Int(0)));                             // unbox the selector
+Prim(Lookup, _,        { // note: this is the slow path, Send tries the send caches and the method cache first
+                         value_t recv = load(Int(-1));                                   // arg(1)
+                         value_t sel  = load(Int(0));                                    // the selector
                          value_t cls  = classOf(recv);
-                         while (cls != nil) {
-                           classSlots *_cls = asClass(cls);
-                           for (int idx = 0; idx < IntValue(_cls->vTableSize); idx++)
-                             if (slotAt(_cls->sels, Int(idx)) == sel) {
-                               value_t method = slotAt(_cls->impls, Int(idx));
-                               deref_(load(Int(0)), method);                             // replace selector (in box) w/ closure
-                               return method;
-                             }
-                           cls = _cls->super;
+                         int     idx  = cls != nil ? methodIdx(cls, sel) : 0;             // (inherited methods included)
+                         if (cls != nil && slotAt(asClass(cls)->sels, Int(idx)) == sel) {
+                           value_t method = slotAt(asClass(cls)->impls, Int(idx));
+                           store(Int(0), method);                                        // replace selector w/ closure
+                           return method;
                          }
                          error("%o does not understand \"%o\"", asClass(classOf(recv))->name, sel);
                          return nil; })
 
-Prim(Send, nArgs,      { fp = Int(IntValue(sp) - IntValue(nArgs) - 1);
+value_t cachedLookup(value_t site) {
+  value_t recv = load(Int(-1)), sel = load(Int(0)), cls = classOf(recv);
+  countSend(sel, cls);
+  if (isOop(site)) {
+    sendCacheSlots *sc = asSendCache(site);
+    value_t n = __atomic_load_n(&sc->epoch, __ATOMIC_ACQUIRE) == Int(sendCacheEpoch) ?
+                __atomic_load_n(&sc->numEntries, __ATOMIC_ACQUIRE) : Int(0); // (a stale one is emptied below)
+    for (int i = 0; i < IntValue(n); i++)
+      if (sc->entries[i].cls == cls && sc->entries[i].sel == sel) {
+        sendCacheHits++;
+        value_t method = sc->entries[i].method;
+        store(Int(0), method);                                         // replace selector w/ closure, like Lookup
+        return method;
+      }
+    sendCacheMisses++;
+  }
+  if (methodCacheFlushed != methodCacheFlushes) {
+    memset(methodCache, 0, sizeof(methodCache));
+    methodCacheFlushed = methodCacheFlushes;
+  }
+  sendCacheEntry *e = &methodCache[methodCacheIdx(cls, sel)];
+  value_t method;
+  if (e->cls == cls && e->sel == sel && e->method != nil) {
+    methodCacheHits++;
+    method = e->method;
+    store(Int(0), method);
+  }
+  else {
+    methodCacheMisses++;
+    method    = _p(Lookup);
+    e->cls    = cls;
+    e->sel    = sel;
+    e->method = method;
+  }
+  if (isOop(site)) {
+    lockShared(&cacheLock);
+    sendCacheSlots *sc = asSendCache(site);
+    if (sc->epoch != Int(sendCacheEpoch)) {
+      memset(sc->entries, 0, sizeof(sc->entries));
+      sc->numEntries = Int(0);
+      __atomic_store_n(&sc->epoch, Int(sendCacheEpoch), __ATOMIC_RELEASE);
+    }
+    int n = IntValue(sc->numEntries);
+    if (n == PICSize)
+      __atomic_store_n(&sc->numEntries, Int(-1), __ATOMIC_RELEASE); // too many (class, selector) pairs: go megamorphic
+    else if (n >= 0) {
+      fieldAtPut(site, sendCacheSlots, entries[n].cls,    cls);
+      fieldAtPut(site, sendCacheSlots, entries[n].sel,    sel);
+      fieldAtPut(site, sendCacheSlots, entries[n].method, method);
+      __atomic_store_n(&sc->numEntries, Int(n + 1), __ATOMIC_RELEASE);
+    }
+    unlockShared(&cacheLock);
+  }
+  return method;
+}
+
+// Quickening: a send site whose receiver and argument have been Ints QuickenThreshold times in a row, and whose method is
+// one of the primitives in quickenings (i.e., a trampoline made by installPrimAsMethod), has its Send rewritten in place
+// to the quickened opcode, e.g., SendAdd, which works on the tagged ints directly. A quickened send deoptimizes (back to
+// Send) when its guard fails: for good if the types changed or the result overflowed, and until it's stable again if the
+// methods did (i.e., the send cache epoch moved on). Quickened sends aren't in the send profile.
+const int QuickenThreshold = 16;
+value_t quickenings[MaxNumPrims]; // the opcode that a send to each primitive (as a method) is quickened to, or nil
+
+value_t primOfTrampoline(value_t code) { // answers the primitive that code calls w/ DoPrim, see installPrimAsMethod
+  value_t *instrs = slots(code);
+  return numSlots(code) == Int(8) && opPrim(instrs[2]) == Push && opPrim(instrs[4]) == DoPrim && isInt(instrs[3]) ?
+         instrs[3] : nil;
+}
+
+void profileSend(value_t site, value_t code) { // called by Send (before it jumps to code) to quicken its own instruction
+  sendCacheSlots *sc    = asSendCache(site);
+  value_t         prim  = primOfTrampoline(code), quick = prim != nil ? quickenings[IntValue(prim)] : nil;
+  value_t         n     = __atomic_load_n(&sc->intSends, __ATOMIC_RELAXED); // (other workers may be sending from it, too)
+  if (n == Int(-1))
+    return;
+  else if (quick == nil || sc->nArgs != Int(2) || !isInt(load(Int(-1))) || !isInt(load(Int(-2))))
+    __atomic_store_n(&sc->intSends, Int(0), __ATOMIC_RELAXED);
+  else if (IntValue(n) + 1 < QuickenThreshold)
+    __atomic_store_n(&sc->intSends, Int(IntValue(n) + 1), __ATOMIC_RELAXED);
+  // only a Send has a send cache for its operand, but a send from C (see send1) isn't the instruction at ip
+  else if (IntValue(ip) >= 0 && 2 * IntValue(ip) < IntValue(numSlots(ipb)) && slotAt(ipb, Int(2 * IntValue(ip) + 1)) == site)
+    __atomic_store_n(&slots(ipb)[2 * IntValue(ip)], opWord(quick, handlerOffsets[IntValue(quick)]), __ATOMIC_RELAXED);
+}
+
+Prim(Send, site,       { // site is either the number of arguments or a send cache (see mkSendCache)
+                         value_t nArgs = isInt(site) ? site : asSendCache(site)->nArgs;
+                         fp = Int(IntValue(sp) - IntValue(nArgs) - 1);
                          store(Int(1), nArgs);
                          store(Int(4), ip);
-                         value_t method = _p(Lookup);
-                         ipb = slotAt(method, Int(0)); // get the code out of the closure
+                         value_t method = cachedLookup(site);
+                         value_t code   = bytecode(slotAt(method, Int(0))); // get the code out of the closure
+                         if (isOop(site))
+                           profileSend(site, code);
+                         ipb = code;
                          ip  = Int(-1);
                          return ipb; })
 
+// what an assembled instruction's operand is: a Send's number of arguments becomes a send cache of its own (so that
+// every send site has its own PIC and type feedback, see cachedLookup and profileSend), anything else stays as it is
+value_t sendOperand(value_t prim, value_t operand) {
+  return prim == Send && isInt(operand) ? mkSendCache(operand) : operand;
+}
+
+value_t deoptSend(value_t site) { // sends what the quickened send at ip couldn't handle
+  sendCacheSlots *sc    = asSendCache(site);
+  value_t        *instr = slots(ipb) + 2 * IntValue(ip);
+  if (opPrim(instr[0]) != Send) { // (native code keeps calling the quickened opcode, see jitCompile)
+    __atomic_store_n(&instr[0], opWord(Send, handlerOffsets[IntValue(Send)]), __ATOMIC_RELAXED);
+    __atomic_store_n(&sc->intSends, __atomic_load_n(&sc->epoch, __ATOMIC_RELAXED) == Int(sendCacheEpoch) ? Int(-1) : Int(0),
+                     __ATOMIC_RELAXED);
+  }
+  return pSend(site);
+}
+
+#define SendCacheEpoch(site)              __atomic_load_n(&asSendCache(site)->epoch, __ATOMIC_RELAXED)
+
+// pops the operands of a quickened send, and what its PrepCall and Push sel pushed, then pushes r (i.e., what Ret would do)
+#define QuickResult(r)                    ({ value_t _r = r, *_s = slots(stack);                                             \
+                                             for (int _i = 0; _i < 4 + 1 + 2; _i++) _s[IntValue(sp) - 1 - _i] = nil;         \
+                                             sp = Int(IntValue(sp) - 4 - 1 - 2);                                             \
+                                             _p1(Push, _r); })
+// (Ok is an expression that computes the result into x, and answers whether it fits, see fitsInt)
+#define QuickSend(site, a, b, x, Ok)      ({ value_t b = slotAt(stack, Int(IntValue(sp) - 1));                                \
+                                             value_t a = slotAt(stack, Int(IntValue(sp) - 2));                                \
+                                             value_t x;                                                                      \
+                                             isInt(a) && isInt(b) && SendCacheEpoch(site) == Int(sendCacheEpoch) &&          \
+                                               (Ok) ? QuickResult(Int(x)) : deoptSend(site); })
+#define Fits(Op, a, b, x)                 (!__builtin_##Op##_overflow(IntValue(a), IntValue(b), &x) && fitsInt(x))
+
+Prim(SendAdd, site,    { return QuickSend(site, a, b, x, Fits(add, a, b, x)); }) // a + send to an Int
+Prim(SendSub, site,    { return QuickSend(site, a, b, x, Fits(sub, a, b, x)); })
+Prim(SendMul, site,    { return QuickSend(site, a, b, x, Fits(mul, a, b, x)); })
+Prim(SendLt,  site,    { return QuickSend(site, a, b, x, (x = IntValue(a) < IntValue(b), 1)); })
+
 Prim(Jmp, n,           { ip = Int(IntValue(ip) + IntValue(n));    })
 Prim(JZ,  n,           { if (IntValue(_p(Pop)) == 0) _p1(Jmp, n); })
-Prim(JNZ, n,           { if (IntValue(_p(Pop)) != 0) _p1(Jmp, n); })
+Prim(JNZ, n,           { if (IntValue(_p(Pop)) != 0) _p1(Jmp, n); }) // (so Push 0; Eq; JZ n  is  JNZ n)
+Prim(JNE, n,           { if (IntValue(_p(Pop)) != IntValue(_p(Pop))) _p1(Jmp, n); }) // Eq; JZ n
 
 Prim(Halt, _,          { })
 
 PMeth(ObjIdentityHash, { return Int(recv); })
 
-PMeth(NilPrint,        { printf("nil");                                           })
-PMeth(IntPrint,        { printf("%d", IntValue(recv));                            })
-PMeth(StrPrint,        { for (int idx = 0; idx < IntValue(numSlots(recv)); idx++)
-                           putchar(IntValue(slotAt(recv, Int(idx))));             })
+PMeth(NilPrint,        { outPrintf("nil");                                        })
+PMeth(IntPrint,        { outInt(IntValue(recv));                                  })
+PMeth(StrPrint,        { outWrite((const char *)asStr(recv)->bytes, IntValue(asStr(recv)->length)); })
 PMeth(ObjPrint,        { if (classOf(recv) == nil)
-                           printf("???[");
-                         else
-                           printf2("%o[", asClass(classOf(recv))->name);
+                           outPrintf("???[");
+                         else {
+                           printValue(asClass(classOf(recv))->name);
+                           outChar('[');
+                         }
                          for (int i = 0; i < IntValue(numSlots(recv)); i++) {
-                           if (i > 0) printf(", ");
-                           fsend1(sPrint, slotAt(recv, Int(i)));
+                           if (i > 0) outWrite(", ", 2);
+                           printValue(slotAt(recv, Int(i)));
                          }
-                         putchar(']');                                            })
-PMeth(ObjPrintln,      { fsend1(sPrint, recv); putchar('\n');                     })
+                         outChar(']');                                             })
+PMeth(ObjPrintln,      { printValue(recv); outChar('\n');                          })
+
+// sends print to x, except that when x's print method is (still) one of the primitives above, it calls that directly,
+// which saves ObjPrint, ObjPrintln, and %o a nested interp() for most of what they print
+void printValue(value_t x) {
+  value_t cls = classOf(x);
+  if (cls != nil && asClass(cls)->sels != nil) {
+    int idx = methodIdx(cls, sPrint);
+    if (slotAt(asClass(cls)->sels, Int(idx)) == sPrint) {
+      value_t code = slotAt(slotAt(asClass(cls)->impls, Int(idx)), Int(0));
+      value_t prim = isBytecode(code) ? primOfTrampoline(code) : nil; // (not assembling it here means no allocation)
+      if (prim == NilPrint || prim == IntPrint || prim == StrPrint || prim == ObjPrint) {
+        HandleScope;
+        handle(x); // (in case ObjPrint ends up sending print to one of x's slots, and that allocates)
+        _p1(prim, x);
+        return;
+      }
+    }
+  }
+  fsend1(sPrint, x);
+}
 
-Prim(PrintOT,     _,   { for (int i = 0; i < OTSize; i++) {
+// the methods of OutStream, whose one instance (stdOut) is how BML code gets at the VM's output buffer (see out)
+PMeth(OutWrite,           { value_t x = _p1(Arg, Int(2));    // a string's bytes go out as they are, anything else is printed
+                            if (x != nil && isOop(x) && classOf(x) == Str)
+                              outWrite((const char *)asStr(x)->bytes, IntValue(asStr(x)->length));
+                            else
+                              printValue(x);
+                            return recv; })
+PMeth(OutFlush,           { outFlush();
+                            return recv; })
+// the flush policies (see out): flushLines, flushExplicitly, and flushEvery: n, which flushes once n >= 1 bytes are buffered
+PMeth(OutFlushLines,      { outSetPolicy(OutLine, OutBufSize);
+                            return recv; })
+PMeth(OutFlushExplicitly, { outSetPolicy(OutExplicit, OutBufSize);
+                            return recv; })
+PMeth(OutFlushEvery,      { value_t n = _p1(Arg, Int(2));
+                            if (!isInt(n) || IntValue(n) < 1)
+                              error("flushEvery: wants a positive number of bytes, not %o", n);
+                            outSetPolicy(OutSize, IntValue(n));
+                            return recv; })
+
+Prim(PrintOT,     _,   { StopTheWorld;
+                         for (size_t i = 0; i < OTSize; i++) {
                            OTEntry *e = &OT[i];
-                           printf("%d: ", i);
+                           outPrintf("%zu: ", i);
                            if (IntValue(e->numSlots) == -1) {
                              int next = e->ptr.next - OT;
-                             printf("(free, next=%d)\n", next >= 0 ? next : -1);
+                             outPrintf("(free, next=%d)\n", next >= 0 ? next : -1);
                            }
                            else {
                              printf2("%o[", asClass(e->cls)->name);
                              for (int n = 0; n < IntValue(e->numSlots); n++) {
                                value_t v = e->ptr.slots[n];
-                               if (n > 0) printf(", ");
-                               if (isInt(v)) printf("i%d", IntValue(v)); // ints are shown as i123
-                               else          printf("r%d", OopValue(v)); // references are shown as r123
+                               if (n > 0) outPrintf(", ");
+                               if (isInt(v)) outPrintf("i%lld", (long long)IntValue(v)); // ints are shown as i123
+                               else          outPrintf("r%lld", (long long)OopValue(v)); // references are shown as r123
                              }
-                             printf("]\n");
+                             outPrintf("]\n");
                            }
                          } })
 
-value_t interp(value_t prog, value_t retFp = Int(-1)) {
-  ipb = prog;
-  ip  = Int(0);
+Prim(SendCacheStats, _, { value_t r = mk(4); // [send cache hits, send cache misses, method cache hits, method cache misses]
+                          slotAtPut(r, Int(0), Int(sendCacheHits));
+                          slotAtPut(r, Int(1), Int(sendCacheMisses));
+                          slotAtPut(r, Int(2), Int(methodCacheHits));
+                          slotAtPut(r, Int(3), Int(methodCacheMisses));
+                          return r; })
+
+Prim(AllocStats, sizeClass, { // [cell size in slots, # allocs, # frees, # live, # slabs, # mk()s, # words mk()-ed,
+                               int c = IntValue(sizeClass);  //  # slots live] (the allocs, frees, live, and slabs only
+                               if (!isInt(sizeClass) || c < 0 || c > LargeObjects) // count old bodies)
+                                 error("AllocStats: bad size class %o", sizeClass);
+                               value_t r = mk(8);
+                               slotAtPut(r, Int(0), Int(c == LargeObjects ? -1 : sizeClasses[c].cellSize));
+                               slotAtPut(r, Int(1), Int(sizeClasses[c].numAllocs));
+                               slotAtPut(r, Int(2), Int(sizeClasses[c].numFrees));
+                               slotAtPut(r, Int(3), Int(sizeClasses[c].numLive));
+                               slotAtPut(r, Int(4), Int(sizeClasses[c].numSlabs));
+                               slotAtPut(r, Int(5), Int(mkCounts[c]));
+                               slotAtPut(r, Int(6), Int(mkWords[c]));
+                               slotAtPut(r, Int(7), Int(sizeClasses[c].numSlotsLive));
+                               return r; })
+
+Prim(GCPauseStats, kind, { // [count, total us, max us, count in bucket 0, count in bucket 1, ...], see recordPause()
+                           int k     = IntValue(kind);
+                           int total = 0;
+                           if (!isInt(kind) || k < 0 || k >= NumPauseKinds)
+                             error("GCPauseStats: bad pause kind %o", kind);
+                           value_t r = mk(3 + NumPauseBuckets);
+                           for (size_t b = 0; b < NumPauseBuckets; b++) {
+                             slotAtPut(r, Int(3 + b), Int(pauseCounts[k][b]));
+                             total += pauseCounts[k][b];
+                           }
+                           slotAtPut(r, Int(0), Int(total));
+                           slotAtPut(r, Int(1), Int((int)(pauseTotals[k] * 1e6)));
+                           slotAtPut(r, Int(2), Int((int)(pauseMaxes[k]  * 1e6)));
+                           return r; })
+
+Prim(PrimStats, prim,  { return Int(primCounts[IntValue(prim)]); }) // the number of times interp() has executed prim
+
+Prim(SendStats, _,     { value_t r = mk(3 * sendProfileSize); // [selector, receiver class, # sends, selector, ...]
+                         for (size_t i = 0, n = 0; i < sendProfileCapacity; i++)
+                           if (sendProfile[i].count > 0) {
+                             slotAtPut(r, Int(n++), sendProfile[i].sel);
+                             slotAtPut(r, Int(n++), sendProfile[i].cls);
+                             slotAtPut(r, Int(n++), Int(sendProfile[i].count));
+                           }
+                         return r; })
+
+Prim(GCStats, _,       { value_t r = mk(5); // [# minor GCs, # major GCs, # marked, # reclaimed, # promoted]
+                         slotAtPut(r, Int(0), Int(gcCounts.minorGCs));
+                         slotAtPut(r, Int(1), Int(gcCounts.majorGCs));
+                         slotAtPut(r, Int(2), Int(gcCounts.marked));
+                         slotAtPut(r, Int(3), Int(gcCounts.reclaimed));
+                         slotAtPut(r, Int(4), Int(gcCounts.promoted));
+                         return r; })
+
+// When the STATS_FILE environment variable is set, dumpStats() appends all of the counters to that file at exit, and
+// whenever the process gets a SIGUSR1 (the signal handler only sets a flag, which interp() polls between time slices, see
+// shouldYield). Every line is a record: a kind (prim, send, alloc, gc, cache, or pause), a name, and some numbers.
+
+const char *statsPath;
+volatile sig_atomic_t statsDumpRequested = 0;
+
+void fputStr(FILE *f, value_t s) { // (only for strings and symbols)
+  fwrite(asStr(s)->bytes, 1, IntValue(asStr(s)->length), f);
+}
+
+void fputClassName(FILE *f, value_t cls) { // (the class may have been reclaimed)
+  if (cls == nil || OT[OopValue(cls)].numSlots == Int(-1))
+    fprintf(f, "???");
+  else
+    fputStr(f, asClass(cls)->name);
+}
+
+void dumpStats(const char *path) {
+  FILE *f = initDone ? fopen(path, "a") : NULL; // (primNames are still C strings before that)
+  if (f == NULL)
+    return;
+  fprintf(f, "# pid %d, %.3f\n", (int)getpid(), now());
+  for (size_t p = 0; p < numPrims; p++)
+    if (primCounts[p] > 0) {
+      fprintf(f, "prim ");
+      fputStr(f, (value_t)(intptr_t)primNames[p]);
+      fprintf(f, " %zu\n", primCounts[p]);
+    }
+  for (size_t i = 0; i < sendProfileCapacity; i++) {
+    sendProfileEntry *e = &sendProfile[i];
+    if (e->count == 0 || OT[OopValue(e->sel)].numSlots == Int(-1))
+      continue;
+    fprintf(f, "send ");
+    fputStr(f, e->sel);
+    fprintf(f, " ");
+    fputClassName(f, e->cls);
+    fprintf(f, " %zu\n", e->count);
+  }
+  for (int c = 0; c <= LargeObjects; c++)
+    if (mkCounts[c] > 0)
+      fprintf(f, "alloc %s%zu %zu %zu\n", c == LargeObjects ? ">" : "", c == LargeObjects ? MaxSlabSlots : sizeClasses[c].cellSize,
+              mkCounts[c], mkWords[c] * sizeof(value_t)); // size class (in slots), # allocs, # bytes
+  fprintf(f, "gc minorGCs %zu\ngc majorGCs %zu\ngc marked %zu\ngc reclaimed %zu\ngc promoted %zu\n", gcCounts.minorGCs,
+          gcCounts.majorGCs, gcCounts.marked, gcCounts.reclaimed, gcCounts.promoted);
+  fprintf(f, "cache sendCacheHits %zu\ncache sendCacheMisses %zu\ncache methodCacheHits %zu\ncache methodCacheMisses %zu\n",
+          sendCacheHits, sendCacheMisses, methodCacheHits, methodCacheMisses);
+  for (int k = 0; k < NumPauseKinds; k++) {
+    size_t count = 0;
+    for (size_t b = 0; b < NumPauseBuckets; b++)
+      count += pauseCounts[k][b];
+    fprintf(f, "pause ");
+    for (const char *c = pauseNames[k]; *c != 0; c++)
+      fputc(*c == ' ' ? '_' : *c, f);
+    fprintf(f, " %zu %.3f %.3f\n", count, pauseTotals[k] * 1e3, pauseMaxes[k] * 1e3); // # pauses, total ms, max ms
+  }
+  fclose(f);
+}
+
+// A census tallies the live objects and their bytes per (class, allocation site). Site 0 holds the exact totals for each
+// class; the others only count the sampled objects, scaled up by heapSampleRate. When HEAP_PROFILE is set, each census is
+// appended to that file, followed by its differences from the one before, as lines like
+//   class Point 120 1920                      # class, # objects, # bytes
+//   site main@12:3;foo@40:7;Point 16 256      # allocation site (outermost frame first) and class, # objects, # bytes
+//   diff site main@12:3;foo@40:7;Point +8 +128
+// so  awk '$1 == "site" { print $2, $4 }'  turns a census into the folded stacks that flamegraph.pl takes.
+
+typedef struct { value_t cls; int site; size_t numObjects, numBytes; } censusEntry;
+typedef struct { censusEntry *entries; size_t size, capacity; } census;
+census      censuses[2]; // the latest one, and the one before it
+int         latestCensus = 0;
+size_t      numCensuses  = 0;
+const char *heapProfilePath;
+
+censusEntry *censusSlot(census *c, value_t cls, int site) { // answers (cls, site)'s entry, or the empty one for it
+  size_t mask = c->capacity - 1, i = ((size_t)cls * 31 + site) & mask;
+  while (c->entries[i].numObjects > 0 && (c->entries[i].cls != cls || c->entries[i].site != site))
+    i = (i + 1) & mask;
+  return &c->entries[i];
+}
+
+void censusAdd(census *c, value_t cls, int site, size_t numObjects, size_t numBytes) {
+  if (2 * (c->size + 1) > c->capacity) { // keep it at most half full
+    censusEntry *old = c->entries;
+    size_t oldCapacity = c->capacity;
+    c->capacity = oldCapacity > 0 ? oldCapacity * 2 : 256;
+    c->entries  = allocate(c->capacity, censusEntry);
+    for (size_t i = 0; i < oldCapacity; i++)
+      if (old[i].numObjects > 0)
+        *censusSlot(c, old[i].cls, old[i].site) = old[i];
+    free(old);
+  }
+  censusEntry *e = censusSlot(c, cls, site);
+  if (e->numObjects == 0) {
+    e->cls  = cls;
+    e->site = site;
+    c->size++;
+  }
+  e->numObjects += numObjects;
+  e->numBytes   += numBytes;
+}
+
+void takeHeapCensus(void) {
+  census *c = &censuses[latestCensus = 1 - latestCensus];
+  memset(c->entries, 0, c->capacity * sizeof(censusEntry));
+  c->size = 0;
+  for (size_t i = 0; i < OTSize; i++) {
+    if (OT[i].numSlots == Int(-1))
+      continue;
+    size_t numBytes = IntValue(OT[i].numSlots) * sizeof(value_t);
+    censusAdd(c, OT[i].cls, 0, 1, numBytes);
+    if (allocSiteOf[i] != 0)
+      censusAdd(c, OT[i].cls, allocSiteOf[i], heapSampleRate, heapSampleRate * numBytes);
+  }
+  numCensuses++;
+}
+
+void fputAllocSite(FILE *f, int site) { // as a folded stack, i.e., the frames separated by ';', outermost first
+  allocSite *s = &allocSites[site];
+  if (s->parent != 0) {
+    fputAllocSite(f, s->parent);
+    fputc(';', f);
+  }
+  if (s->code == nil) {
+    fprintf(f, "vm");
+    return;
+  }
+  if (s->fn == nil)
+    fprintf(f, "main");
+  else if (s->fn == Int(0) || OT[OopValue(s->fn)].numSlots == Int(-1) || classOf(s->fn) != Str)
+    fprintf(f, "fn");
+  else
+    fputStr(f, s->fn); // a selector
+  fprintf(f, "@%d:%d", (int)OopValue(s->code), (int)IntValue(s->ip));
+}
+
+void fputCensusEntry(FILE *f, const char *prefix, censusEntry *e, const char *fmt, long numObjects, long numBytes) {
+  fprintf(f, "%s%s ", prefix, e->site == 0 ? "class" : "site");
+  if (e->site != 0) {
+    fputAllocSite(f, e->site);
+    fputc(';', f);
+  }
+  fputClassName(f, e->cls);
+  fprintf(f, fmt, numObjects, numBytes);
+}
+
+void writeHeapCensus(const char *path) {
+  FILE *f = fopen(path, "a");
+  if (f == NULL)
+    return;
+  census *c = &censuses[latestCensus], *prev = &censuses[1 - latestCensus];
+  fprintf(f, "# census %zu, pid %d, %.3f, sample rate %zu\n", numCensuses, (int)getpid(), now(), heapSampleRate);
+  for (size_t i = 0; i < c->capacity; i++)
+    if (c->entries[i].numObjects > 0)
+      fputCensusEntry(f, "", &c->entries[i], " %ld %ld\n", c->entries[i].numObjects, c->entries[i].numBytes);
+  for (size_t i = 0; numCensuses > 1 && i < c->capacity; i++) {
+    censusEntry *e = &c->entries[i], *p = censusSlot(prev, e->cls, e->site);
+    if (e->numObjects > 0 && (e->numObjects != p->numObjects || e->numBytes != p->numBytes))
+      fputCensusEntry(f, "diff ", e, " %+ld %+ld\n", (long)e->numObjects - (long)p->numObjects,
+                      (long)e->numBytes - (long)p->numBytes);
+  }
+  for (size_t i = 0; numCensuses > 1 && i < prev->capacity; i++) { // the ones that are gone altogether
+    censusEntry *p = &prev->entries[i];
+    if (p->numObjects > 0 && censusSlot(c, p->cls, p->site)->numObjects == 0)
+      fputCensusEntry(f, "diff ", p, " %+ld %+ld\n", -(long)p->numObjects, -(long)p->numBytes);
+  }
+  fclose(f);
+}
+
+void heapCensus(void) { // called at the end of every major collection
+  if (heapProfilePath == NULL || !initDone)
+    return;
+  takeHeapCensus();
+  writeHeapCensus(heapProfilePath);
+}
+
+Prim(HeapSampleRate, rate, { StopTheWorld;
+                             value_t old = Int(heapSampleRate); // 0 turns the heap profiler's sampling off
+                             if (!isInt(rate) || IntValue(rate) < 0)
+                               error("HeapSampleRate: bad rate %o", rate);
+                             setHeapSampleRate(IntValue(rate));
+                             return old; })
+
+Prim(HeapCensus, _,    { StopTheWorld;
+                         gc(); // [class, # live objects, # bytes, class, ...], right after a full collection
+                         if (heapProfilePath == NULL)
+                           takeHeapCensus();
+                         census  *c     = &censuses[latestCensus];
+                         value_t *tally = allocate(3 * c->size, value_t); // (mk() could take another census)
+                         int      n     = 0;
+                         for (size_t i = 0; i < c->capacity; i++)
+                           if (c->entries[i].numObjects > 0 && c->entries[i].site == 0) {
+                             tally[n++] = c->entries[i].cls;
+                             tally[n++] = Int(c->entries[i].numObjects);
+                             tally[n++] = Int(c->entries[i].numBytes);
+                           }
+                         value_t r = mk(n);
+                         for (int i = 0; i < n; i++)
+                           slotAtPut(r, Int(i), tally[i]);
+                         free(tally);
+                         return r; })
+
+void dumpStatsAtExit(void)       { dumpStats(statsPath); }
+void requestStatsDump(int)       { statsDumpRequested = 1; }
+
+// the primitives that get their own handlers in interp() (so they're called directly, and can be inlined)
+#define ThreadedPrims(X)                  X(Push) X(Pop) X(Eq) X(Add) X(Sub) X(Mul) X(Box) X(Unbox) X(Ld) X(St) X(Arg) X(Fv) \
+                                          X(StVar) X(MkFun) X(PrepCall) X(DoPrim) X(AddI) X(SubI)
+// ... and the ones after which a green thread can be preempted (every loop and every recursion goes through one of them)
+#define PreemptionPoints(X)               X(Call) X(TCall) X(Send) X(Jmp) X(JZ) X(JNZ) X(JNE)
+
+const int PreemptQuantum = 10000; // preemption points per time slice
+__thread int preemptCountdown = PreemptQuantum, schedulerRunning = 0, threadYielded = 0;
+
+// Green threads only yield from the interp() at the bottom of their C stack (retFp = -1): a nested one, e.g., for a send
+// from a primitive, has C frames above it that can't be switched out.
+inline int shouldYield(value_t retFp) {
+  if (--preemptCountdown >= 0)
+    return 0;
+  preemptCountdown = PreemptQuantum;
+  if (safepointRequested())
+    safepoint();
+  if (statsDumpRequested && workerId == 0) {
+    statsDumpRequested = 0;
+    dumpStats(statsPath);
+  }
+  return schedulerRunning && retFp == Int(-1);
+}
+
+// A baseline JIT for x86-64 (see the JIT environment variable). Once a code array has been entered JitThreshold times,
+// jitCompile() translates it into machine code by stitching together a template for each instruction. The native code
+// keeps sp and fp (untagged) in ebx and r12d, the address of the stack's slots in r13, and its size in r14d (an instruction
+// that pushes exits to interp() when the stack is full, and Push grows it there). Branches become native
+// branches (the backward ones count down preemptCountdown, like shouldYield), the simple instructions are inlined, and the
+// rest call their primitives through jitCallPrim(). The instructions that leave the code array (Call, TCall, Send, Ret,
+// and Halt) exit to interp(), which re-enters native code after a call or a return, see runNative(). The instructions
+// that run natively aren't in primCounts. A code array that's replaced (by become) goes back to being counted, and the
+// code of a method that's replaced by InstMeth is never compiled again, so frames that are still in it are interpreted.
+
+const int JitThreshold = 1000, NativeNotRun = 0, NativeRan = 1, NativePreempted = 2;
+int jitEnabled = 0;
+
+#if defined(__x86_64__) && !defined(NO_JIT)
+typedef struct { int (*run)(void **entries, int ip, value_t *stackSlots); void **entries; } jitFunction;
+
+const size_t JitCodeCapacity = 64 * 1024 * 1024;
+jitFunction *jitFunctions;
+byte_t      *jitCode, *jitBuf;                           // the native code, and the function that's being assembled
+int         *jitLabels, *jitFixups;                      // the offsets of the instructions, and (offset, instr) pairs
+size_t       numJitFunctions = 0, jitFunctionsCapacity = 0, jitCodeSize = 0, jitBufSize = 0, jitBufCapacity = 0,
+             numJitFixups = 0, jitFixupsCapacity = 0;
+
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, R12 = 12, R13 = 13 }; // (rbx holds sp, and r12 holds fp)
+int jitStackSize; // the number of slots in the current stack, for r14d
+const int RexW = sizeof(value_t) == 8 ? 0x08 : 0, SlotScale = sizeof(value_t) == 8 ? 3 : 2; // (for the value_t width)
+
+void jitByte(int b) {
+  if (jitBufSize == jitBufCapacity) {
+    jitBufCapacity = jitBufCapacity > 0 ? jitBufCapacity * 2 : 4096;
+    jitBuf         = (byte_t *)realloc(jitBuf, jitBufCapacity);
+  }
+  jitBuf[jitBufSize++] = b;
+}
+
+#define jit(...)                          ({ int _b[] = { __VA_ARGS__ };                                                      \
+                                             for (size_t _i = 0; _i < sizeof(_b) / sizeof(int); _i++) jitByte(_b[_i]); })
+
+void jit4(int32_t x)                      { for (int i = 0; i < 4; i++) jitByte((x >> (8 * i)) & 0xFF); }
+void jitMovAbs(int reg, const void *p)    { jit(0x48, 0xB8 + reg);   // mov reg, imm64
+                                            for (int i = 0; i < 8; i++) jitByte(((uintptr_t)p >> (8 * i)) & 0xFF); }
+void jitCallAbs(const void *f)            { jitMovAbs(RAX, f); jit(0xFF, 0xD0); } // call rax
+void jitRexW(void)                        { if (RexW) jitByte(0x40 | RexW); } // (the instruction that follows is on a value_t)
+void jitMovImm(int reg, value_t x) { // mov reg, x
+  if (x != (int32_t)x)
+    jitMovAbs(reg, (const void *)(intptr_t)x);
+  else if (RexW) {
+    jit(0x48, 0xC7, 0xC0 + reg); jit4(x); // (sign-extended)
+  }
+  else {
+    jit(0xB8 + reg); jit4(x);
+  }
+}
+
+void jitSlot(int opcode, int reg, int idx, int slot) { // opcode reg, [r13 + (idx + slot) * sizeof(value_t)], a stack slot
+  jit(0x40 | RexW | (reg >> 3) << 2 | (idx >> 3) << 1 | 1, opcode, 0x80 | (reg & 7) << 3 | 4, SlotScale << 6 | (idx & 7) << 3 | 5);
+  jit4(slot * (int)sizeof(value_t));
+}
+
+void jitJump(int jcc, int target) { // jcc is the second byte of a (0x0F-prefixed) conditional jump, or 0 for jmp
+  if (jcc == 0) jit(0xE9);
+  else          jit(0x0F, jcc);
+  if (numJitFixups + 2 > jitFixupsCapacity) {
+    jitFixupsCapacity = jitFixupsCapacity > 0 ? jitFixupsCapacity * 2 : 256;
+    jitFixups         = (int *)realloc(jitFixups, jitFixupsCapacity * sizeof(int));
+  }
+  jitFixups[numJitFixups++] = jitBufSize;
+  jitFixups[numJitFixups++] = target;
+  jit4(0);
+}
+
+void jitStoreRegisters(void) { // clobbers rcx and rdx
+  jitRexW();             jit(0x8D, 0x0C, 0x5D); jit4(1); jitMovAbs(RDX, &sp); jitRexW(); jit(0x89, 0x0A); // lea rcx, [rbx * 2 + 1]; mov [rdx], rcx
+  jit(0x42 | RexW, 0x8D, 0x0C, 0x65);           jit4(1); jitMovAbs(RDX, &fp); jitRexW(); jit(0x89, 0x0A); // lea rcx, [r12 * 2 + 1]; ...
+}
+
+void jitLoadRegisters(void) { // clobbers rax
+  jitMovAbs(RAX, &sp); jit(0x8B, 0x00, 0xD1, 0xF8, 0x89, 0xC3);       // mov eax, [rax]; sar eax, 1; mov ebx, eax
+  jitMovAbs(RAX, &fp); jit(0x8B, 0x00, 0xD1, 0xF8, 0x41, 0x89, 0xC4); // ... mov r12d, eax
+  jitMovAbs(RAX, &jitStackSize); jit(0x44, 0x8B, 0x30);               // mov r14d, [rax]
+}
+
+void jitExit(int ipIdx, int result) { // back to interp(), which goes on from instruction ipIdx + 1
+  jit(0xBE); jit4(ipIdx);  // mov esi, ipIdx
+  jit(0xB8); jit4(result); // mov eax, result
+  jitJump(0, -2);          // to the epilogue
+}
+
+void jitWriteBarrier(value_t v)           { writeBarrier(OopValue(stack), v); }
+value_t *jitCallPrim(int prim, value_t op) { // answers NULL if the primitive went somewhere else, e.g., DoPrim w/ Call
+  value_t code = ipb, here = ip;
+  primCounts[prim]++;
+  prims[prim](op);
+  jitStackSize = IntValue(numSlots(stack));
+  return ipb == code && ip == here ? slots(stack) : NULL;
+}
+
+void jitBarrier(void) { // for the value in rax, which has just been stored into the stack
+  jit(0xA8, 0x01, 0x75, RexW ? 15 : 14); // test al, 1; jnz (over the rest)
+  jitRexW(); jit(0x89, 0xC7);            // mov rdi, rax
+  jitCallAbs((void *)jitWriteBarrier);
+}
+
+void jitPopInto(int reg) { // dec ebx; mov reg, [top]; mov [top], nil
+  jit(0xFF, 0xCB);
+  jitSlot(0x8B, reg, RBX, 0);
+  jitSlot(0xC7, 0, RBX, 0); jit4(nil);
+}
+
+void jitBranch(int jcc, int k, int target) { // a backward one counts down preemptCountdown, see shouldYield
+  if (target > k) {
+    jitJump(jcc, target);
+    return;
+  }
+  size_t skip = 0;
+  if (jcc != 0) {
+    jit(0x70 | ((jcc & 0xF) ^ 1), 0); // the opposite short jump, over the rest
+    skip = jitBufSize;
+  }
+  jitMovAbs(RAX, &preemptCountdown);
+  jit(0x83, 0x28, 0x01);              // sub dword [rax], 1
+  jitJump(0x89, target);              // jns target
+  jitExit(target - 1, NativePreempted);
+  if (jcc != 0)
+    jitBuf[skip - 1] = jitBufSize - skip;
+}
+
+void jitExitUnless(int jcc, int k) { // jcc is a short conditional jump: unless it's taken, interp() runs instruction k
+  jit(jcc, 0);                       // (over the exit)
+  size_t skip = jitBufSize;
+  jitExit(k - 1, NativeRan);
+  jitBuf[skip - 1] = jitBufSize - skip;
+}
+
+void jitOverflowExit(int k)             { jitExitUnless(0x71, k); }                      // jno, after arithmetic: k reports it
+void jitStackCheck(int k)               { jit(0x44, 0x39, 0xF3); jitExitUnless(0x72, k); } // cmp ebx, r14d; jb: k grows it
+
+void jitArith(value_t prim, int k) { // Eq, Add, Sub, or Mul: rcx = a op b, on the tagged values (w/ the overflow flag)
+  jitSlot(0x8B, RAX, RBX, -1);                                              // b
+  jitSlot(0x8B, RCX, RBX, -2);                                              // a
+  if (prim == Eq) {
+    jitRexW(); jit(0xD1, 0xF8); jitRexW(); jit(0xD1, 0xF9);                 // sar rax, 1; sar rcx, 1
+    jitRexW(); jit(0x39, 0xC1, 0x0F, 0x94, 0xC1, 0x0F, 0xB6, 0xC9);         // cmp rcx, rax; sete cl; movzx ecx, cl
+    jit(0x8D, 0x0C, 0x4D); jit4(1);                                         // lea ecx, [rcx * 2 + 1]
+  }
+  else {
+    if (prim == Mul) {
+      jitRexW(); jit(0xD1, 0xF8); jitRexW(); jit(0xFF, 0xC9);               // sar rax, 1; dec rcx
+      jitRexW(); jit(0x0F, 0xAF, 0xC8);                                     // imul rcx, rax
+    }
+    else {
+      jitRexW(); jit(0xFF, 0xC8); jitRexW(); jit(prim == Add ? 0x01 : 0x29, 0xC1); // dec rax; add/sub rcx, rax
+    }
+    jitOverflowExit(k);
+    if (prim == Mul) {
+      jitRexW(); jit(0x83, 0xC9, 0x01);                                     // or rcx, 1
+    }
+  }
+  jit(0xFF, 0xCB);                                                          // dec ebx
+  jitSlot(0xC7, 0, RBX, 0); jit4(nil);
+  jitSlot(0x89, RCX, RBX, -1);
+}
+
+int jitCompile(value_t code) { // answers whether it could
+  int      n      = IntValue(numSlots(code)) / 2;
+  value_t *instrs = slots(code);
+  jitBufSize = numJitFixups = 0;
+  jitLabels  = (int *)realloc(jitLabels, (n + 2) * sizeof(int));
+  jit(0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56);       // push rbx; push r12; push r13; push r14
+  jit(0x48, 0x83, 0xEC, 0x08, 0x49, 0x89, 0xD5);       // sub rsp, 8 (to keep it 16-byte aligned); mov r13, rdx
+  jitLoadRegisters();
+  jit(0x89, 0xF6, 0xFF, 0x24, 0xF7);                   // mov esi, esi; jmp [rdi + rsi * 8]
+  for (int k = 0; k < n; k++) {
+    value_t prim = opPrim(instrs[2 * k]), op = instrs[2 * k + 1];
+    int     target = k + (isInt(op) ? IntValue(op) : 0) + 1;
+    jitLabels[k] = jitBufSize;
+    if (prim == Push) {
+      jitStackCheck(k);
+      jitMovImm(RAX, op);
+      jitSlot(0x89, RAX, RBX, 0);
+      jit(0xFF, 0xC3);                   // inc ebx
+      if (isOop(op))
+        jitBarrier();
+    }
+    else if (prim == Pop)
+      jitPopInto(RAX);
+    else if (prim == Arg || prim == Ld) {
+      jitStackCheck(k);
+      jitSlot(0x8B, RAX, R12, (prim == Arg ? 1 : -1) * IntValue(op));
+      jitSlot(0x89, RAX, RBX, 0);
+      jit(0xFF, 0xC3);
+      jitBarrier();
+    }
+    else if (prim == St) {
+      jitPopInto(RAX);
+      jitSlot(0x89, RAX, R12, -IntValue(op));
+      jitBarrier();
+    }
+    else if (prim == Eq || prim == Add || prim == Sub || prim == Mul)
+      jitArith(prim, k);
+    else if ((prim == AddI || prim == SubI) && (!isInt(op) || op - 1 != (int32_t)(op - 1)))
+      return 0;
+    else if (prim == AddI || prim == SubI) {
+      jitSlot(0x8B, RAX, RBX, -1);
+      jitRexW(); jit(prim == AddI ? 0x05 : 0x2D); jit4(op - 1); // add/sub rax, 2 * k
+      jitOverflowExit(k);
+      jitSlot(0x89, RAX, RBX, -1);
+    }
+    else if ((prim == Jmp || prim == JZ || prim == JNZ || prim == JNE) && (target < 0 || target >= n))
+      return 0;
+    else if (prim == Jmp)
+      jitBranch(0, k, target);
+    else if (prim == JZ || prim == JNZ) {
+      jitPopInto(RAX);
+      jitRexW(); jit(0xD1, 0xF8); jitRexW(); jit(0x85, 0xC0); // sar rax, 1; test rax, rax
+      jitBranch(prim == JZ ? 0x84 : 0x85, k, target);
+    }
+    else if (prim == JNE) {
+      jitPopInto(RAX);
+      jitPopInto(RCX);
+      jitRexW(); jit(0xD1, 0xF8); jitRexW(); jit(0xD1, 0xF9); jitRexW(); jit(0x39, 0xC1); // sar rax, 1; sar rcx, 1; cmp rcx, rax
+      jitBranch(0x85, k, target);
+    }
+    else if (prim == Call || prim == TCall || prim == Send || prim == Ret || prim == Halt)
+      jitExit(k - 1, NativeRan);
+    else { // call the primitive
+      jitStoreRegisters();
+      jitMovAbs(RDX, &ip); jitRexW(); jit(0xC7, 0x02); jit4(Int(k)); // mov [rdx], Int(k)
+      jit(0xBF); jit4(IntValue(prim));                               // mov edi, prim
+      jitMovImm(RSI, op);                                            // mov rsi, op
+      jitCallAbs((void *)jitCallPrim);
+      jit(0x48, 0x85, 0xC0);                              // test rax, rax
+      jitJump(0x84, -1);                                  // jz (to the bail-out)
+      jit(0x49, 0x89, 0xC5);                              // mov r13, rax (the stack's slots may have moved)
+      jitLoadRegisters();
+    }
+  }
+  jitLabels[n] = jitBufSize; // the bail-out: interp() goes on from wherever the primitive left ip
+  jitLoadRegisters();
+  jitMovAbs(RDX, &ip); jit(0x8B, 0x32, 0xD1, 0xFE, 0xB8); jit4(NativeRan); // mov esi, [rdx]; sar esi, 1; mov eax, ...
+  jitLabels[n + 1] = jitBufSize; // the epilogue: esi is the index of the last instruction that ran, eax is the result
+  if (RexW) jit(0x48, 0x63, 0xF6);                                      // movsxd rsi, esi
+  jitRexW(); jit(0x8D, 0x0C, 0x75); jit4(1); jitMovAbs(RDX, &ip);       // lea rcx, [rsi * 2 + 1]
+  jitRexW(); jit(0x89, 0x0A);                                           // mov [rdx], rcx
+  jitStoreRegisters();
+  jit(0x48, 0x83, 0xC4, 0x08, 0x41, 0x5E);                              // add rsp, 8; pop r14
+  jit(0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);                              // pop r13; pop r12; pop rbx; ret
+  for (size_t i = 0; i < numJitFixups; i += 2) {
+    int at = jitFixups[i], target = jitFixups[i + 1] < 0 ? n - 1 - jitFixups[i + 1] : jitFixups[i + 1];
+    int rel = jitLabels[target] - (at + 4);
+    memcpy(&jitBuf[at], &rel, 4);
+  }
+
+  if (jitCode == NULL &&
+      (jitCode = (byte_t *)mmap(NULL, JitCodeCapacity, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+    jitCode = NULL;
+  if (jitCode == NULL || jitCodeSize + jitBufSize > JitCodeCapacity)
+    return 0;
+  size_t pageSize = sysconf(_SC_PAGESIZE), start = jitCodeSize & ~(pageSize - 1), end = jitCodeSize + jitBufSize;
+  if (mprotect(jitCode + start, end - start, PROT_READ | PROT_WRITE) != 0)
+    return 0;
+  memcpy(jitCode + jitCodeSize, jitBuf, jitBufSize);
+  mprotect(jitCode + start, end - start, PROT_READ | PROT_EXEC);
+  if (numJitFunctions == jitFunctionsCapacity) {
+    jitFunctionsCapacity = jitFunctionsCapacity > 0 ? jitFunctionsCapacity * 2 : 64;
+    jitFunctions         = (jitFunction *)realloc(jitFunctions, jitFunctionsCapacity * sizeof(jitFunction));
+  }
+  jitFunction *f = &jitFunctions[numJitFunctions];
+  f->run     = (int (*)(void **, int, value_t *))(jitCode + jitCodeSize);
+  f->entries = allocate(n, void *);
+  for (int k = 0; k < n; k++)
+    f->entries[k] = jitCode + jitCodeSize + jitLabels[k];
+  jitCodeSize += (jitBufSize + 15) & ~15;
+  jitInfo[OopValue(code)] = -2 - numJitFunctions++;
+  return 1;
+}
+
+// ip is the instruction before the one to run next; count is 1 on a call or a backward branch (which is how code gets hot)
+int runNative(int count) {
+  int *info = &jitInfo[OopValue(ipb)];
+  if (*info >= 0 && (*info += count) < JitThreshold)
+    return NativeNotRun;
+  else if (*info >= 0 && !jitCompile(ipb)) {
+    *info = JitNever;
+    return NativeNotRun;
+  }
+  else if (*info == JitNever)
+    return NativeNotRun;
+  jitFunction *f = &jitFunctions[-2 - *info];
+  jitStackSize = IntValue(numSlots(stack));
+  return f->run(f->entries, IntValue(ip) + 1, slots(stack));
+}
+#else
+int runNative(int count)                  { return NativeNotRun; }
+#endif
+
+value_t interp(value_t prog, value_t retFp) {
+#ifndef NO_THREADED_DISPATCH
+  // Direct threading: each op word holds the offset of its handler from &&generic, and every handler ends by jumping
+  // straight to the next instruction's handler. Debug mode uses the loop below (which traces every instruction) instead.
+  static void *handlers[MaxNumPrims];
+  if (handlers[0] == NULL) {
+    for (size_t p = 0; p < MaxNumPrims; p++)
+      handlers[p] = &&generic;
+#define X(Name) handlers[IntValue(Name)] = &&do##Name;
+    ThreadedPrims(X)
+    PreemptionPoints(X)
+#undef X
+    handlers[IntValue(Ret)]  = &&doRet;
+    handlers[IntValue(Halt)] = &&doHalt;
+    for (size_t p = 0; p < MaxNumPrims; p++)
+      handlerOffsets[p] = (char *)handlers[p] - (char *)&&generic;
+  }
+#endif
+  if (prog == nil) // just filling in handlerOffsets
+    return nil;
+  else if (prog == Resume)
+    ip = Int(IntValue(ip) + 1);
+  else {
+    ipb = bytecode(prog);
+    ip  = Int(0);
+  }
+#ifndef NO_THREADED_DISPATCH
+  if (!debug) {
+    value_t *instr, op;
+    int count;
+#define Dispatch()                        ({ instr = slots(ipb) + 2 * IntValue(ip); op = instr[1];                            \
+                                             primCounts[IntValue(opPrim(instr[0]))]++;                                       \
+                                             goto *(void *)((char *)&&generic + opHandlerOffset(instr[0])); })
+#define Next()                            ({ ip = Int(IntValue(ip) + 1); Dispatch(); })
+    Dispatch();
+  generic:
+    prims[IntValue(opPrim(instr[0]))](op);
+    Next();
+#define X(Name) do##Name: p##Name(op); Next();
+    ThreadedPrims(X)
+#undef X
+#define X(Name) do##Name: p##Name(op); if (shouldYield(retFp)) goto yield;                                                \
+                  if (jitEnabled && (ip == Int(-1) || IntValue(op) < 0)) { count = 1; goto jit; } Next();
+    PreemptionPoints(X)
+#undef X
+  jit:
+    if (runNative(count) == NativePreempted && shouldYield(retFp))
+      goto yield;
+    Next();
+  yield:
+    threadYielded = 1;
+    return nil;
+  doRet:
+    pRet(op);
+    if (fp == retFp)
+      return _p(Pop);
+    else if (jitEnabled) {
+      count = 0;
+      goto jit;
+    }
+    Next();
+  doHalt:
+    ip = Int(IntValue(ip) + 1);
+    return _p(Pop);
+#undef Next
+#undef Dispatch
+  }
+#endif
   while (1) {
-    value_t instr = slotAt(ipb, ip), primIdx = IntValue(car(instr)), op = cdr(instr);
+    value_t *instr = slots(ipb) + 2 * IntValue(ip), primIdx = IntValue(opPrim(instr[0])), op = instr[1];
     dPrintf2("\n\n%S\nExecuting instruction <<%o %o>>\n", primNames[primIdx], op);
-    if (0 <= primIdx && primIdx < numPrims) prims[primIdx](op);
-    else                                    error("%d is not a valid primitive\n", primIdx);
+    primCounts[primIdx]++;
+    prims[primIdx](op); // (bytecode() has already checked primIdx)
     ip = Int(IntValue(ip) + 1);
     dPrintf2("\n%S\n\n\n");
     if (primIdx == IntValue(Halt))
@@ -468,91 +2744,703 @@ value_t interp(value_t prog, value_t retFp = Int(-1)) {
       ip = Int(IntValue(ip) - 1); // undo increment of ip
       break;
     }
+#define X(Name) primIdx == IntValue(Name) ||
+    int preemptionPoint = PreemptionPoints(X) 0;
+#undef X
+    if (preemptionPoint && shouldYield(retFp)) {
+      ip = Int(IntValue(ip) - 1); // Resume increments it
+      threadYielded = 1;
+      return nil;
+    }
+    else if (jitEnabled && !debug && (primIdx == IntValue(Ret) || (preemptionPoint && (ip == Int(0) || IntValue(op) < 0)))) {
+      ip = Int(IntValue(ip) - 1); // (see runNative)
+      if (runNative(primIdx != IntValue(Ret)) == NativePreempted && shouldYield(retFp)) {
+        threadYielded = 1;
+        return nil;
+      }
+      ip = Int(IntValue(ip) + 1);
+    }
   }
   return _p(Pop);
 }
 
 value_t fsend1(value_t sel, value_t recv) { value_t retFp = PrepSend(sel, recv); return DoSend(1, retFp); }
 
-PMeth(IntAdd,    { return Int(IntValue(recv) + IntValue(deref(_p1(Arg, Int(2))))); })
-PMeth(IntSub,    { return Int(IntValue(recv) - IntValue(deref(_p1(Arg, Int(2))))); })
-PMeth(IntMul,    { return Int(IntValue(recv) * IntValue(deref(_p1(Arg, Int(2))))); })
-
-PMeth(StrCmp,    { value_t s1 = recv;
-                   value_t s2 = _p(Pop);
-                   for (int idx = Int(0); 1; idx = Int(IntValue(idx) + 1)) {
-                     int c1   = idx < numSlots(s1) ? IntValue(slotAt(s1, idx)) : 0;
-                     int c2   = idx < numSlots(s2) ? IntValue(slotAt(s2, idx)) : 0;
-                     int diff = c1 - c2;
-                     if      (diff != 0) return Int(diff);
-                     else if (c1 == 0)   return Int(0);
-                   } })
-
-PMeth(StrIntern, { value_t internedStrings = deref(internedStringsRef);
-                   for (value_t curr = internedStrings; curr != nil; curr = cdr(curr)) {
-                     value_t internedString = car(curr);
-                     if (_p2(StrCmp, recv, internedString) == Int(0))
-                       return internedString;
+// Green threads. Each one is a context: its registers live in its header while it's switched out (ipb goes in code),
+// and its stack follows. runThreads(n) runs them a time slice at a time on n workers: the thread that calls it (worker
+// 0) and n - 1 OS threads. Every worker has a run queue, a preempted thread goes back on the queue of the worker that
+// ran it, and a worker whose queue is empty steals from the tails of the others'. Besides its registers, a worker has
+// its own handles, nursery, free OT entries, and method cache, so a slice only synchronizes w/ the others to allocate
+// in the old space, to fill a send cache, and to stop the world (see stopWorld). The JIT is off while there's more than
+// one worker, since native code has worker 0's registers baked into it.
+
+typedef struct { pthread_mutex_t lock; value_t *ctxs; size_t head, size, capacity; /* a ring buffer */ } runQueue;
+
+runQueue runQueues[MaxWorkers]; // the threads that are waiting for a time slice
+int numThreads = 0;             // (the workers read it w/o locking, to see when they're done)
+size_t numSlices = 0, numSteals = 0;
+value_t threadsRef; // an array of the live green threads, see spawn() and retire()
+pthread_mutex_t threadsLock = PTHREAD_MUTEX_INITIALIZER;
+
+void enqueue(runQueue *q, value_t ctx) {
+  lockShared(&q->lock);
+  if (q->size == q->capacity) {
+    size_t oldCapacity = q->capacity;
+    q->capacity = oldCapacity > 0 ? oldCapacity * 2 : 64;
+    q->ctxs     = (value_t *)realloc(q->ctxs, q->capacity * sizeof(value_t));
+    memcpy(q->ctxs + oldCapacity, q->ctxs, q->head * sizeof(value_t)); // unwrap
+  }
+  q->ctxs[(q->head + q->size) % q->capacity] = ctx;
+  __atomic_store_n(&q->size, q->size + 1, __ATOMIC_RELAXED);
+  unlockShared(&q->lock);
+}
+
+value_t dequeue(runQueue *q, int fromTail) { // (thieves take from the tail, so the owner's threads still take turns)
+  if (__atomic_load_n(&q->size, __ATOMIC_RELAXED) == 0)
+    return nil;
+  lockShared(&q->lock);
+  value_t ctx = nil;
+  if (q->size > 0 && fromTail)
+    ctx = q->ctxs[(q->head + q->size - 1) % q->capacity];
+  else if (q->size > 0) {
+    ctx     = q->ctxs[q->head];
+    q->head = (q->head + 1) % q->capacity;
+  }
+  if (ctx != nil)
+    __atomic_store_n(&q->size, q->size - 1, __ATOMIC_RELAXED);
+  unlockShared(&q->lock);
+  return ctx;
+}
+
+void saveRegisters(void) {
+  slotAtPut(stack, ctxSlot(code), ipb);
+  slotAtPut(stack, ctxSlot(ip),   ip);
+  slotAtPut(stack, ctxSlot(sp),   sp);
+  slotAtPut(stack, ctxSlot(fp),   fp);
+}
+
+void restoreRegisters(value_t ctx) {
+  stack = ctx;
+  ipb   = slotAt(ctx, ctxSlot(code));
+  ip    = slotAt(ctx, ctxSlot(ip));
+  sp    = slotAt(ctx, ctxSlot(sp));
+  fp    = slotAt(ctx, ctxSlot(fp));
+}
+
+value_t spawn(value_t prog) { // prog is a code array that ends w/ Halt, like a compiled script; returns the new thread
+  HandleScope;
+  value_t ctx = handle(mkContext());
+  slotAtPut(ctx, ctxSlot(code), bytecode(prog));
+  slotAtPut(ctx, ctxSlot(ip),   Int(-1));
+  slotAtPut(ctx, ctxSlot(sp),   Int(ContextHeaderSlots));
+  slotAtPut(ctx, ctxSlot(fp),   Int(ContextHeaderSlots));
+  while (1) {
+    lockShared(&threadsLock);
+    value_t threads = deref(threadsRef);
+    int     n       = numThreads;
+    if (n < IntValue(numSlots(threads))) {
+      slotAtPut(threads, Int(n), ctx);
+      slotAtPut(ctx, ctxSlot(id), Int(n));
+      __atomic_store_n(&numThreads, n + 1, __ATOMIC_RELEASE);
+      unlockShared(&threadsLock);
+      break;
+    }
+    unlockShared(&threadsLock);
+    HandleScope;
+    handle(threads);
+    value_t bigger = handle(mkTenured(2 * n)); // (w/o the lock, since allocating may mean stopping the world)
+    lockShared(&threadsLock);
+    if (deref(threadsRef) == threads) { // (i.e., another worker didn't grow it in the meantime)
+      for (int i = 0; i < numThreads; i++)
+        slotAtPut(bigger, Int(i), slotAt(threads, Int(i)));
+      deref_(threadsRef, bigger);
+    }
+    unlockShared(&threadsLock);
+  }
+  enqueue(&runQueues[workerId], ctx);
+  return ctx;
+}
+
+void retire(value_t ctx, value_t result) { // removes a finished thread from the threads array
+  lockShared(&threadsLock);
+  value_t threads = deref(threadsRef), last = slotAt(threads, Int(numThreads - 1));
+  int id = IntValue(slotAt(ctx, ctxSlot(id)));
+  slotAtPut(threads, Int(id), last);
+  slotAtPut(last, ctxSlot(id), Int(id));
+  slotAtPut(threads, Int(numThreads - 1), nil);
+  slotAtPut(ctx, ctxSlot(id),     Int(-1));
+  slotAtPut(ctx, ctxSlot(result), result);
+  __atomic_store_n(&numThreads, numThreads - 1, __ATOMIC_RELEASE);
+  unlockShared(&threadsLock);
+}
+
+void runSlice(value_t ctx) {
+  restoreRegisters(ctx);
+  threadYielded    = 0;
+  preemptCountdown = PreemptQuantum;
+  value_t r = interp(Resume);
+  __atomic_add_fetch(&numSlices, 1, __ATOMIC_RELAXED);
+  if (threadYielded)
+    saveRegisters();
+  stack = nil; // (once it's back on a queue, another worker may run it, see publish())
+  if (threadYielded)
+    enqueue(&runQueues[workerId], ctx);
+  else
+    retire(ctx, r);
+}
+
+void runWorker(void) { // runs slices until there are no threads left
+  while (__atomic_load_n(&numThreads, __ATOMIC_ACQUIRE) > 0) {
+    if (safepointRequested())
+      safepoint();
+    value_t ctx = dequeue(&runQueues[workerId], 0);
+    for (int k = 1; ctx == nil && k < numWorkers; k++)
+      if ((ctx = dequeue(&runQueues[(workerId + k) % numWorkers], 1)) != nil)
+        __atomic_add_fetch(&numSteals, 1, __ATOMIC_RELAXED);
+    if (ctx != nil)
+      runSlice(ctx);
+    else
+      sched_yield(); // (the others are running the rest of them)
+  }
+  pthread_mutex_lock(&worldLock); // from here on, nobody waits for this worker to park
+  while (stopRequested)
+    parkLocked();
+  publish();
+  numRunning--;
+  pthread_cond_signal(&workerParked);
+  pthread_mutex_unlock(&worldLock);
+}
+
+// what the workers other than worker 0 counted (see dumpStats), for runThreads() to add to worker 0's counts
+#define WorkerCounters(X)                 X(primCounts) X(mkCounts) X(mkWords) X(sendCacheHits) X(sendCacheMisses)          \
+                                          X(methodCacheHits) X(methodCacheMisses)
+#define X(counter) + sizeof(counter) / sizeof(size_t)
+const size_t NumWorkerCounts = 0 WorkerCounters(X); // (they're all size_ts)
+#undef X
+typedef struct { size_t counts[NumWorkerCounts]; sendProfileEntry *sendProfile; size_t sendProfileCapacity; } workerCounters;
+workerCounters finishedCounters[MaxWorkers];
+
+void *workerMain(void *arg) {
+  workerId            = (int)(intptr_t)arg;
+  stack = ipb         = nil;
+  nurseryTop          = workers[workerId].nurseryTop;
+  nurseryEnd          = nurseryOf(workerId) + NurserySize;
+  heapSampleCountdown = heapSampleRate;
+  schedulerRunning    = 1;
+  growSendProfile();
+  runWorker();
+  workerCounters *c     = &finishedCounters[workerId];
+  size_t         *count = c->counts;
+#define X(counter) count = (size_t *)mempcpy(count, &counter, sizeof(counter));
+  WorkerCounters(X)
+#undef X
+  c->sendProfile         = sendProfile;
+  c->sendProfileCapacity = sendProfileCapacity;
+  free(handles); // (there are none left, see publish())
+  return NULL;
+}
+
+void runThreads(int n) { // runs the green threads on n workers until they're all done
+  if (schedulerRunning)
+    error("runThreads() can't be called from a green thread");
+  n = n < 1 ? 1 : n > MaxWorkers ? MaxWorkers : n;
+  HandleScope;
+  value_t caller = handle(stack);
+  int     jit    = jitEnabled;
+  saveRegisters();
+  if (n > 1) {
+    while (gcPhase == Marking) // (the write barrier doesn't shade atomically, see makeRoomFor)
+      markStep();
+    jitEnabled = 0;
+  }
+  schedulerRunning = 1;
+  numWorkers = numRunning = n;
+  pthread_t others[MaxWorkers];
+  for (int w = 1; w < n; w++)
+    if (pthread_create(&others[w], NULL, workerMain, (void *)(intptr_t)w) != 0)
+      error("couldn't start a worker");
+  runWorker();
+  for (int w = 1; w < n; w++) {
+    pthread_join(others[w], NULL);
+    workerCounters *c     = &finishedCounters[w];
+    size_t         *count = c->counts;
+#define X(counter) for (size_t i = 0; i < sizeof(counter) / sizeof(size_t); i++) ((size_t *)&counter)[i] += *count++;
+    WorkerCounters(X)
+#undef X
+    for (size_t i = 0; i < c->sendProfileCapacity; i++)
+      if (c->sendProfile[i].count > 0)
+        countSend(c->sendProfile[i].sel, c->sendProfile[i].cls, c->sendProfile[i].count);
+    free(c->sendProfile);
+  }
+  numWorkers       = 1;
+  nurseryTop       = workers[0].nurseryTop; // (another worker may have collected since worker 0 was done)
+  schedulerRunning = 0;
+  jitEnabled       = jit;
+  restoreRegisters(caller);
+}
+
+Prim(Spawn,      prog,  { return spawn(prog); })
+Prim(RunThreads, n,     { runThreads(isInt(n) ? IntValue(n) : 1); return nil; }) // n is the number of workers (1 w/o it)
+Prim(ThreadResult, ctx, { return slotAt(ctx, ctxSlot(result)); }) // nil until the thread is done
+
+PMeth(IntAdd,    { return IntArith(add, recv, _p1(Arg, Int(2))); })
+PMeth(IntSub,    { return IntArith(sub, recv, _p1(Arg, Int(2))); })
+PMeth(IntMul,    { return IntArith(mul, recv, _p1(Arg, Int(2))); })
+PMeth(IntLt,     { return Int(IntValue(recv) < IntValue(_p1(Arg, Int(2)))); })
+
+void initQuickenings(void) { // see profileSend
+  quickenings[IntValue(IntAdd)] = SendAdd;
+  quickenings[IntValue(IntSub)] = SendSub;
+  quickenings[IntValue(IntMul)] = SendMul;
+  quickenings[IntValue(IntLt)]  = SendLt;
+}
+
+// compares 8 bytes at a time: the first byte where the words differ, or where s1 has a 0, decides (like strcmp, the
+// strings are equal up to their first 0). Every string has a 0 in its last word, so this never runs off the end of either.
+int strCmp(value_t s1, value_t s2) {
+  const byte_t *b1 = asStr(s1)->bytes, *b2 = asStr(s2)->bytes;
+  for (size_t off = 0; 1; off += 8) {
+    uint64_t w1, w2;
+    memcpy(&w1, b1 + off, 8);
+    memcpy(&w2, b2 + off, 8);
+    uint64_t diffs = w1 ^ w2,
+             zeros = (w1 - 0x0101010101010101ull) & ~w1 & 0x8080808080808080ull; // the lowest set bit is exact
+    if ((diffs | zeros) == 0)
+      continue;
+    int idx = off + __builtin_ctzll(diffs | zeros) / 8;                          // (assumes a little-endian host)
+    return b1[idx] - b2[idx];
+  }
+}
+
+PMeth(StrCmp,    { value_t s2 = _p(Pop);
+                   return Int(strCmp(recv, s2)); })
+
+// The symbol table is an open-addressing hash table w/ linear probing. Each entry's hash is cached in a (binary) array
+// alongside the strings, so a probe only looks at the characters of strings w/ the same hash, and growing the table
+// doesn't rehash any strings.
+
+const size_t OrigSymbolTableSize = 256; // must be a power of 2
+
+value_t strHash(value_t s) {            // FNV-1a, up to the first 0 (that's where StrCmp stops, too); cached in the string
+  strSlots *_s = asStr(s);
+  if (_s->hash != 0)
+    return _s->hash;
+  unsigned h = 2166136261u;
+  for (const byte_t *c = _s->bytes; *c != 0; c++)
+    h = (h ^ *c) * 16777619u;
+  return _s->hash = Int(h & 0x3FFFFFFF);
+}
+
+value_t mkSymbolTable(size_t size) {
+  HandleScope;
+  value_t table = handle(mk(sizeof(symbolTableSlots) / sizeof(value_t)));
+  fieldAtPut(table, symbolTableSlots, hashes,  mkBinary(size));
+  fieldAtPut(table, symbolTableSlots, strings, mkTenured(size)); // (old from the start, so minorGC can treat it as weak)
+  asSymbolTable(table)->tally   = Int(0);
+  asSymbolTable(table)->numUsed = Int(0);
+  return table;
+}
+
+// answers the index of the entry that holds a string equal to s, or (if there is no such entry) the index where s should go
+int symbolTableIdx(value_t table, value_t s, value_t hash) {
+  symbolTableSlots *_table = asSymbolTable(table);
+  int mask = IntValue(numSlots(_table->strings)) - 1, freeIdx = -1;
+  for (int idx = IntValue(hash) & mask; 1; idx = (idx + 1) & mask) {
+    value_t entry = slotAt(_table->strings, Int(idx));
+    if (entry == nil)
+      return freeIdx >= 0 ? freeIdx : idx;
+    else if (entry == Tombstone) {
+      if (freeIdx < 0) freeIdx = idx;
+    }
+    else if (slotAt(_table->hashes, Int(idx)) == hash && (entry == s || strCmp(s, entry) == 0))
+      return idx;
+  }
+}
+
+void symbolTableGrow(size_t newSize) {
+  value_t newTable = mkSymbolTable(newSize); // (nothing below allocates)
+  value_t oldTable = deref(internedStringsRef);
+  symbolTableSlots *_old = asSymbolTable(oldTable), *_new = asSymbolTable(newTable);
+  for (int idx = 0; idx < IntValue(numSlots(_old->strings)); idx++) {
+    value_t entry = slotAt(_old->strings, Int(idx));
+    if (entry == nil || entry == Tombstone)
+      continue;
+    value_t hash   = slotAt(_old->hashes, Int(idx));
+    int     newIdx = IntValue(hash) & (newSize - 1);
+    while (slotAt(_new->strings, Int(newIdx)) != nil)
+      newIdx = (newIdx + 1) & (newSize - 1);
+    slotAtPut(_new->hashes,  Int(newIdx), hash);
+    slotAtPut(_new->strings, Int(newIdx), entry);
+  }
+  _new->tally   = _old->tally;
+  _new->numUsed = _old->tally;
+  deref_(internedStringsRef, newTable);
+}
+
+PMeth(StrIntern, { HandleScope;
+                   handle(recv); // in case recv is only referred to from C
+                   StopTheWorld; // (the symbol table is shared)
+                   value_t hash = strHash(recv);
+                   int     idx  = symbolTableIdx(deref(internedStringsRef), recv, hash);
+                   value_t s    = slotAt(asSymbolTable(deref(internedStringsRef))->strings, Int(idx));
+                   if (s != nil && s != Tombstone)
+                     return s;
+                   symbolTableSlots *_table = asSymbolTable(deref(internedStringsRef));
+                   size_t size = IntValue(numSlots(_table->strings));
+                   if (s == nil && (size_t)(IntValue(_table->numUsed) + 1) * 4 > size * 3) { // keep the load factor (incl. tombstones) <= 3/4
+                     while ((size_t)(IntValue(_table->tally) + 1) * 2 > size)
+                       size *= 2;
+                     symbolTableGrow(size);
+                     idx    = symbolTableIdx(deref(internedStringsRef), recv, hash);
+                     _table = asSymbolTable(deref(internedStringsRef));
+                     s      = nil;
                    }
-                   _p1(Push, recv); // this Push and the Pop below are needed in case recv is not already on the stack
-                   deref_(internedStringsRef, cons(recv, internedStrings));
-                   _p(Pop);
+                   slotAtPut(_table->hashes,  Int(idx), hash);
+                   slotAtPut(_table->strings, Int(idx), recv);
+                   _table->tally = Int(IntValue(_table->tally) + 1);
+                   if (s == nil)
+                     _table->numUsed = Int(IntValue(_table->numUsed) + 1);
                    return recv; })
 
-value_t stringify(const char *s) {
-  value_t r = _p1(Push, _p2(MkObj, Str, Int(strlen(s))));
-  for (int idx = 0; *s != 0; idx++, s++)
-    slotAtPut(r, Int(idx), Int(*s));
-  _p(Pop);
-  return r;
-}
+value_t stringify(const char *s) { return mkStr(s, strlen(s)); }
 
 void installPrimAsMethod(value_t _class, value_t sel, value_t prim) {
   value_t closure = _p1(Push, ref(nil));
-  value_t code    = deref_(closure, mk(5));
-  slotAtPut(code, Int(0), cons(Arg,    Int(1))); // push boxed receiver
-  slotAtPut(code, Int(1), cons(Unbox,  Int(0))); // unbox the receiver on the stack
-  slotAtPut(code, Int(2), cons(Push,   prim));   // push the primitive
-  slotAtPut(code, Int(3), cons(DoPrim, Int(1)));
-  slotAtPut(code, Int(4), cons(Ret,    nil));    // return (DoPrim's result is top of stack)
+  value_t code    = deref_(closure, mk(4));
+  slotAtPut(code, Int(0), cons(Arg,    Int(1))); // push the receiver
+  slotAtPut(code, Int(1), cons(Push,   prim));   // push the primitive
+  slotAtPut(code, Int(2), cons(DoPrim, Int(1)));
+  slotAtPut(code, Int(3), cons(Ret,    nil));    // return (DoPrim's result is top of stack)
   _p1(Push, sel);
   _p1(InstMeth, _class);
 }
 
-void init(int _debug) {
+// A module is a compiled BML program (see compiler.ojs's makeModule) in a file that the VM can load while it's running. It's
+// a sequence of little-endian 32-bit words:
+//
+//   magic, version, numNames, numLambdas, entry          entry is the index of the top-level code (which ends w/ Halt)
+//   offset(0) ... offset(numLambdas - 1)                 where each lambda starts, in words from the start of the file
+//   for each primitive name: length, bytes ...           padded to a whole word
+//   for each lambda: numInstrs, (op, operand) ...        op = kind << 8 | the index of the primitive's name
+//
+// An operand's kind says what it is: nil, an Int, or (a relocation) a reference to another lambda of the module or to its
+// constant closure (see constClosure), which is made when a lambda that refers to it is linked. Since
+// primitives are named rather than numbered, a module isn't tied to the binary that compiled it the way an image is. The
+// file is mmap-ed, and each lambda starts out as a stub whose only instruction is Link, which builds the lambda's bytecode
+// straight from the file (no cons cells) the first time it runs, and becomes it, so the stub's users never know.
+
+const int ModuleMagic = 0x4d4c4d42, ModuleVersion = 2, ModuleHeaderWords = 5; // ("BMLM")
+enum { OperandNil, OperandInt, OperandLambda, OperandClosure };
+
+typedef struct { const int32_t *words; size_t numWords; int numLambdas, numNames;
+                 value_t stubs, closures;      // arrays of the lambdas' stubs and constant closures (rooted by the globals)
+                 byte_t *linked;
+                 value_t prims[MaxNumPrims];   /* what the module's names stand for */ } module;
+
+module *modules;
+int numModules = 0;
+
+value_t linkLambda(int m, int k) { // answers the bytecode of module m's lambda k
+  module *mod = &modules[m];
+  int32_t off = mod->words[ModuleHeaderWords + k], n = off >= 0 && (size_t)off < mod->numWords ? mod->words[off] : -1;
+  if (n < 0 || (size_t)off + 1 + 2 * (size_t)n > mod->numWords) // (a negative word would wrap around)
+    error("lambda %d of module %d is truncated", k, m);
+  if (handlerOffsets[0] == 0)
+    interp(nil);
+  const int32_t *instrs = mod->words + off + 1;
+  HandleScope;
+  value_t bc = handle(mkTenured(2 * n)); // (like bytecode)
+  for (int idx = 0; idx < n; idx++) {
+    int op = instrs[2 * idx], kind = op >> 8, name = op & 0xFF, operand = instrs[2 * idx + 1];
+    if (op < 0 || name >= mod->numNames || kind > OperandClosure || // (only prims[0..numNames) were resolved by loadModule)
+        (kind >= OperandLambda && (operand < 0 || operand >= mod->numLambdas)))
+      error("bad instruction %d in lambda %d of module %d", idx, k, m);
+    if (kind == OperandClosure && slotAt(mod->closures, Int(operand)) == nil)
+      slotAtPut(mod->closures, Int(operand), constClosure(slotAt(mod->stubs, Int(operand))));
+    value_t prim = mod->prims[name], arg;
+    switch (kind) { case OperandNil:     arg = nil;                                    break;
+                    case OperandInt:     arg = sendOperand(prim, Int(operand));        break;
+                    case OperandLambda:  arg = slotAt(mod->stubs,    Int(operand));    break;
+                    default:             arg = slotAt(mod->closures, Int(operand));    break; }
+    slotAtPut(bc, Int(2 * idx),     opWord(prim, handlerOffsets[IntValue(prim)]));
+    slotAtPut(bc, Int(2 * idx + 1), arg);
+  }
+  mod->linked[k] = 1;
+  return bc;
+}
+
+Prim(Link, where,      { // a stub's only instruction (where is (module . lambda)): replaces the stub w/ the real thing
+                         StopTheWorld;
+                         if (!modules[IntValue(car(where))].linked[IntValue(cdr(where))]) // (another worker may have)
+                           become(ipb, linkLambda(IntValue(car(where)), IntValue(cdr(where))));
+                         ip = Int(-1); // i.e., start over at the real first instruction
+                         return nil; })
+
+void linkAll(void) { // links whatever hasn't run yet (e.g., before an image is saved, since it doesn't include the files)
+  for (int m = 0; m < numModules; m++)
+    for (int k = 0; k < modules[m].numLambdas; k++)
+      if (!modules[m].linked[k])
+        become(slotAt(modules[m].stubs, Int(k)), linkLambda(m, k));
+}
+
+value_t loadModule(const char *path) { // answers the top-level code, which can be given to interp()
+  StopTheWorld; // (Link reads modules)
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    error("couldn't open module %o", stringify(path));
+  struct stat st;
+  void *mapping = fstat(fd, &st) == 0 && (size_t)st.st_size >= ModuleHeaderWords * sizeof(int32_t) ?
+                    mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (mapping == MAP_FAILED)
+    error("couldn't map module %o", stringify(path));
+  const int32_t *w = (const int32_t *)mapping;
+  size_t numWords = st.st_size / sizeof(int32_t), off = ModuleHeaderWords + (w[3] > 0 ? w[3] : 0);
+  if (w[0] != ModuleMagic || w[1] != ModuleVersion || w[2] < 0 || (size_t)w[2] > MaxNumPrims || w[3] <= 0 ||
+      w[4] < 0 || w[4] >= w[3] || off > numWords)
+    error("%o is not a module (or it's from another version of the compiler)", stringify(path));
+  modules = (module *)realloc(modules, (numModules + 1) * sizeof(module));
+  module *mod     = &modules[numModules];
+  mod->words      = w;
+  mod->numWords   = numWords;
+  mod->numLambdas = w[3];
+  mod->numNames   = w[2];
+  mod->linked     = allocate(w[3], byte_t);
+  for (int name = 0; name < w[2]; name++) { // the names are resolved now, so that a module for another VM fails early
+    int32_t len = off < numWords ? w[off] : -1;
+    if (len < 0 || off + 1 + ((size_t)len + 3) / 4 > numWords)
+      error("module %o is truncated", stringify(path));
+    const char *bytes = (const char *)(w + off + 1);
+    mod->prims[name] = nil;
+    for (size_t p = 0; p < numPrims; p++)
+      if (IntValue(asStr((value_t)(intptr_t)primNames[p])->length) == (int)len &&
+          memcmp(asStr((value_t)(intptr_t)primNames[p])->bytes, bytes, len) == 0)
+        mod->prims[name] = Int(p);
+    if (mod->prims[name] == nil)
+      error("module %o uses a primitive that this VM doesn't have", stringify(path));
+    off += 1 + (len + 3) / 4;
+  }
+  mod->stubs    = addGlobal(mk(w[3]));
+  mod->closures = addGlobal(mk(w[3]));
+  for (int k = 0; k < w[3]; k++) {
+    HandleScope;
+    value_t stub  = slotAtPut(mod->stubs, Int(k), mk(1));
+    value_t where = handle(cons(Int(numModules), Int(k)));
+    slotAtPut(stub, Int(0), cons(Link, where));
+  }
+  return slotAt(modules[numModules++].stubs, Int(w[4]));
+}
+
+Prim(LoadModule, path, { char   *p = strdup((const char *)asStr(path)->bytes); // (every string ends in a 0, and the copy
+                         value_t r = loadModule(p);                          // doesn't move if the GC moves path)
+                         free(p);
+                         return r; })
+
+// An image is a snapshot of the heap: the OT, the bodies of the objects, the roots, and the C variables that refer to
+// objects. An image file is only good for the binary that wrote it (bytecode has handler offsets baked into it), which is
+// what handlersHash checks. Since references are OT indices, the bodies don't need to be relocated when they're loaded:
+// the file is mmap-ed (privately, so that writes are copy-on-write), and only the OT's pointers are set up, so loading
+// costs one pass over the OT, and the bodies are paged in as they're touched.
+
+#define ImageRoots(X)                     X(nil) X(stack) X(ipb) X(ip) X(fp) X(sp) X(internedStringsRef) X(chars)              \
+                                          X(threadsRef) X(classesRef) X(Obj) X(Nil) X(Int) X(Str) X(Var) X(Closure) X(Class) X(sIntern)      \
+                                          X(sIdentityHash) X(sPrint) X(sPrintln) X(sAdd) X(sSub) X(sMul)     \
+                                          X(sLt) X(sWrite) X(sFlush) X(sFlushLines) X(sFlushExplicitly) X(sFlushEvery) X(OutStream) X(stdOut)
+
+const int ImageMagic = 0x4e6f5468, ImageVersion = 6;
+
+typedef struct { int magic, version, handlersHash, OTSize, numBodyWords, numRegisters, numGlobals, sendCacheEpoch; } imageHeader;
+typedef struct { value_t numSlots, cls; int isBinary, isContext, offset; /* of the body, in words */          } imageEntry;
+
+int handlersHash(void) { // FNV-1a over the things an image depends on
+  if (handlerOffsets[0] == 0)
+    interp(nil);
+  unsigned h = 2166136261u;
+  int things[] = { (int)numPrims, MaxNumPrims, ContextHeaderSlots, (int)sizeof(value_t) };
+  for (int i = 0; i < 4; i++)
+    h = (h ^ things[i]) * 16777619u;
+  for (size_t p = 0; p < MaxNumPrims; p++)
+    h = (h ^ handlerOffsets[p]) * 16777619u;
+  return h;
+}
+
+void saveImage(const char *path) {
+  if (numThreads > 0)
+    error("can't save an image while there are green threads");
+  linkAll();
+  gc(); // so that there's nothing in the nursery, and nothing that's garbage
+  imageHeader h = { ImageMagic, ImageVersion, handlersHash(), (int)OTSize, 0, 0, (int)numRoots, (int)sendCacheEpoch };
+#define X(root) 1 +
+  h.numRegisters = ImageRoots(X) numPrims;
+#undef X
+  value_t *registers = allocate(h.numRegisters, value_t), *r = registers;
+#define X(root) *r++ = root;
+  ImageRoots(X)
+#undef X
+  for (size_t p = 0; p < numPrims; p++)
+    *r++ = (value_t)(intptr_t)primNames[p];
+  imageEntry *entries = allocate(OTSize, imageEntry);
+  for (size_t i = 0; i < OTSize; i++) {
+    imageEntry *ie = &entries[i];
+    ie->numSlots = OT[i].numSlots;
+    if (OT[i].numSlots == Int(-1))
+      continue;
+    ie->cls      = OT[i].cls;
+    ie->isBinary  = OT[i].isBinary;
+    ie->isContext = OT[i].isContext;
+    ie->offset    = h.numBodyWords;
+    h.numBodyWords += IntValue(OT[i].numSlots);
+  }
+  FILE *f = fopen(path, "wb");
+  if (f == NULL)
+    error("couldn't open the image file for writing");
+  fwrite(&h, sizeof(h), 1, f);
+  fwrite(registers, sizeof(value_t), h.numRegisters, f);
+  fwrite(roots, sizeof(value_t), numRoots, f);
+  fwrite(entries, sizeof(imageEntry), OTSize, f);
+  for (size_t i = 0; i < OTSize; i++)
+    if (OT[i].numSlots != Int(-1))
+      fwrite(OT[i].ptr.slots, sizeof(value_t), IntValue(OT[i].numSlots), f);
+  if (fclose(f) != 0)
+    error("couldn't write the image file");
+  free(registers);
+  free(entries);
+}
+
+int loadImage(const char *path) { // answers 0 (and leaves the heap alone) if there's no usable image at path
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  struct stat st;
+  void *mapping = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(imageHeader) ?
+                    mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return 0;
+  imageHeader *h         = (imageHeader *)mapping;
+  value_t     *registers = (value_t *)(h + 1), *globals = registers + h->numRegisters;
+  imageEntry  *entries   = (imageEntry *)(globals + h->numGlobals);
+  value_t     *bodies    = (value_t *)(entries + h->OTSize);
+  if (h->magic != ImageMagic || h->version != ImageVersion || h->handlersHash != handlersHash() ||
+      (char *)(bodies + h->numBodyWords) != (char *)mapping + st.st_size) {
+    munmap(mapping, st.st_size);
+    return 0;
+  }
+  OTSize         = h->OTSize;
+  OT             = allocate(OTSize, OTEntry);
+  marked         = allocate(OTSize, byte_t);
+  remembered     = allocate(OTSize, byte_t);
+  allocSiteOf    = allocate(OTSize, int);
+  jitInfo        = allocate(OTSize, int);
+  freeList       = NULL;
+  numFreeEntries = 0;
+  for (int i = OTSize - 1; i >= 0; i--) {
+    if (entries[i].numSlots == Int(-1)) {
+      freeEntry(i);
+      continue;
+    }
+    OT[i].numSlots  = entries[i].numSlots;
+    OT[i].cls       = entries[i].cls;
+    OT[i].isBinary  = entries[i].isBinary;
+    OT[i].isContext = entries[i].isContext;
+    OT[i].ptr.slots = bodies + entries[i].offset;
+  }
+  imageMapping     = mapping;
+  imageMappingSize = st.st_size;
+  imageBodies      = bodies;
+  imageEnd         = bodies + h->numBodyWords + 1; // (so that an empty body at the very end counts as in the image)
+  value_t *r = registers;
+#define X(root) root = *r++;
+  ImageRoots(X)
+#undef X
+  for (size_t p = 0; p < numPrims; p++)
+    primNames[p] = (void *)(intptr_t)*r++;
+  for (int g = 0; g < h->numGlobals; g++)
+    addGlobal(globals[g]);
+  numOldRoots = numRoots;
+  sendCacheEpoch = h->sendCacheEpoch + 1; // the send caches in the image were filled by another process
+  return 1;
+}
+
+void init(int _debug, const char *imagePath = NULL) { // loads the image at imagePath, if there is one
   debug   = _debug;
   OTSize  = 0;
-  sp      = Int(0);
+  sp      = Int(ContextHeaderSlots);
   ip      = Int(-1);
+  nursery = allocate(MaxWorkers * NurserySize, value_t);
+  emptyNurseries();
+  nurseryEnd = nursery + NurserySize;
+  markStack     = allocate(MarkStackSize, int);
+  for (int w = 0; w < MaxWorkers; w++)
+    pthread_mutex_init(&runQueues[w].lock, NULL);
+  initSizeClasses();
+  incrementalGC = getenv("INCREMENTAL_GC") != NULL && atoi(getenv("INCREMENTAL_GC")) != 0;
+  compactingGC  = getenv("COMPACTING_GC")  != NULL && atoi(getenv("COMPACTING_GC"))  != 0;
+  jitEnabled    = getenv("JIT")            != NULL && atoi(getenv("JIT"))            != 0;
+  weakSymbols   = getenv("WEAK_SYMBOLS")   != NULL && atoi(getenv("WEAK_SYMBOLS"))   != 0;
+  if (getenv("MARK_THREADS") != NULL) {
+    numMarkThreads = atoi(getenv("MARK_THREADS"));
+    numMarkThreads = numMarkThreads < 1 ? 1 : numMarkThreads > (int)MaxMarkThreads ? (int)MaxMarkThreads : numMarkThreads;
+  }
+  growSendProfile();
+  initQuickenings();
+  const char *flush = getenv("OUTPUT_FLUSH");
+  if      (flush == NULL)                   outSetPolicy(debug || isatty(out.fd) ? OutLine : OutSize, OutBufSize);
+  else if (strcmp(flush, "line")     == 0)  outSetPolicy(OutLine,     OutBufSize);
+  else if (strcmp(flush, "explicit") == 0)  outSetPolicy(OutExplicit, OutBufSize);
+  else                                      outSetPolicy(OutSize,     atoi(flush) > 0 ? atoi(flush) : OutBufSize);
+  atexit(outFlush);
+  if ((statsPath = getenv("STATS_FILE")) != NULL) {
+    atexit(dumpStatsAtExit);
+    signal(SIGUSR1, requestStatsDump);
+  }
+  if ((heapProfilePath = getenv("HEAP_PROFILE")) != NULL) {
+    int rate = getenv("HEAP_SAMPLE_RATE") != NULL ? atoi(getenv("HEAP_SAMPLE_RATE")) : DefaultHeapSampleRate;
+    setHeapSampleRate(rate < 0 ? 0 : rate);
+  }
+  if (imagePath != NULL && loadImage(imagePath)) {
+    initDone = 1;
+    return;
+  }
   growOT();
   nil     = mk(0);   // allocate nil before any other objects so it gets to be 0
-  globals = cons(nil, nil);
-  stack    = addGlobal(mk(sizeof(contextSlots) + 1024));
+  stack    = addGlobal(mkContext()); // the main thread's context
+  threadsRef = addGlobal(ref(mkTenured(16)));
+  classesRef = addGlobal(ref(nil));
   internedStringsRef = addGlobal(ref(nil));
+  deref_(internedStringsRef, mkSymbolTable(OrigSymbolTableSize));
   chars = addGlobal(mk(256));
 
   // "objectify" primNames (they were C strings up to this point)
-  for (int p = 0; p < numPrims; p++)
-    primNames[p] = (void *)_p1(StrIntern, stringify((const char *)primNames[p]));
+  for (size_t p = 0; p < numPrims; p++)
+    primNames[p] = (void *)(intptr_t)addGlobal(_p1(StrIntern, stringify((const char *)primNames[p])));
   
-  sIntern       = _p1(StrIntern, stringify("intern"));
-  sIdentityHash = _p1(StrIntern, stringify("identityHash"));
-  sPrint        = _p1(StrIntern, stringify("print"));
-  sPrintln      = _p1(StrIntern, stringify("println"));
-  sAdd          = _p1(StrIntern, stringify("+"));
-  sSub          = _p1(StrIntern, stringify("-"));
-  sMul          = _p1(StrIntern, stringify("*"));
+  // these are added to the globals in case the symbol table is weak
+  sIntern       = addGlobal(_p1(StrIntern, stringify("intern")));
+  sIdentityHash = addGlobal(_p1(StrIntern, stringify("identityHash")));
+  sPrint        = addGlobal(_p1(StrIntern, stringify("print")));
+  sPrintln      = addGlobal(_p1(StrIntern, stringify("println")));
+  sAdd          = addGlobal(_p1(StrIntern, stringify("+")));
+  sSub          = addGlobal(_p1(StrIntern, stringify("-")));
+  sMul          = addGlobal(_p1(StrIntern, stringify("*")));
+  sLt           = addGlobal(_p1(StrIntern, stringify("<")));
+  sWrite        = addGlobal(_p1(StrIntern, stringify("write:")));
+  sFlush        = addGlobal(_p1(StrIntern, stringify("flush")));
+  sFlushLines      = addGlobal(_p1(StrIntern, stringify("flushLines")));
+  sFlushExplicitly = addGlobal(_p1(StrIntern, stringify("flushExplicitly")));
+  sFlushEvery      = addGlobal(_p1(StrIntern, stringify("flushEvery:")));
 
   Obj = _p3(MkClass, _p1(StrIntern, stringify("Obj")), nil, nil);
     installPrimAsMethod(Obj, sIdentityHash, ObjIdentityHash); 
     installPrimAsMethod(Obj, sPrint,        ObjPrint       );
     installPrimAsMethod(Obj, sPrintln,      ObjPrintln     );
-    for (int idx = 0; idx < OTSize; idx++) {
+    for (size_t idx = 0; idx < OTSize; idx++) {
       if (IntValue(OT[idx].numSlots) < 0)
         continue;
-      OT[idx].cls = Obj;
+      classOf_(Oop(idx), Obj);
     }
-  value_t classSlotNames = _p1(Push, mk(7));
+  HandleScope;
+  value_t classSlotNames = handle(mk(9));
     slotAtPut(classSlotNames, Int(0), _p1(StrIntern, stringify("name"      )));
     slotAtPut(classSlotNames, Int(1), _p1(StrIntern, stringify("slotNames" )));
     slotAtPut(classSlotNames, Int(2), _p1(StrIntern, stringify("numSlots"  )));
@@ -560,10 +3448,11 @@ void init(int _debug) {
     slotAtPut(classSlotNames, Int(4), _p1(StrIntern, stringify("sels"      )));
     slotAtPut(classSlotNames, Int(5), _p1(StrIntern, stringify("impls"     )));
     slotAtPut(classSlotNames, Int(6), _p1(StrIntern, stringify("super     ")));
+    slotAtPut(classSlotNames, Int(7), _p1(StrIntern, stringify("definers"  )));
+    slotAtPut(classSlotNames, Int(8), _p1(StrIntern, stringify("numMethods")));
     assert(numSlots(classSlotNames) == Int(sizeof(classSlots) / sizeof(value_t))); // sanity check
-  Class = addGlobal(_p2(MkObj, Obj, Int(7)));
+  Class = addGlobal(_p2(MkObj, Obj, Int(sizeof(classSlots) / sizeof(value_t))));
     _p4(ClassInit, Class, _p1(StrIntern, stringify("Class")), Obj, classSlotNames);
-    _p(Pop); // pop classSlotNames
     classOf_(Class, Class);
     classOf_(Obj,   Class);
   Int = _p3(MkClass, _p1(StrIntern, stringify("Int")), Obj, nil);
@@ -571,23 +3460,542 @@ void init(int _debug) {
     installPrimAsMethod(Int, sAdd,          IntAdd  );
     installPrimAsMethod(Int, sSub,          IntSub  );
     installPrimAsMethod(Int, sMul,          IntMul  );
+    installPrimAsMethod(Int, sLt,           IntLt   );
   Nil = _p3(MkClass, _p1(StrIntern, stringify("Nil")), Obj, nil);
     installPrimAsMethod(Nil, sPrint, NilPrint);
     classOf_(nil, Nil);
   Str = _p3(MkClass, _p1(StrIntern, stringify("Str")), Obj, nil);
     installPrimAsMethod(Str, sIntern, StrIntern);
     installPrimAsMethod(Str, sPrint,  StrPrint);
-    for (value_t curr = deref(internedStringsRef); curr != nil; curr = cdr(curr)) {
-      value_t internedString = car(curr);
-      OT[OopValue(internedString)].cls = Str;
+    value_t internedStrings = asSymbolTable(deref(internedStringsRef))->strings;
+    for (int idx = 0; idx < IntValue(numSlots(internedStrings)); idx++) {
+      value_t internedString = slotAt(internedStrings, Int(idx));
+      if (internedString != nil && internedString != Tombstone)
+        classOf_(internedString, Str);
     }
+  OutStream = _p3(MkClass, _p1(StrIntern, stringify("OutStream")), Obj, nil);
+    installPrimAsMethod(OutStream, sWrite,           OutWrite          );
+    installPrimAsMethod(OutStream, sFlush,           OutFlush          );
+    installPrimAsMethod(OutStream, sFlushLines,      OutFlushLines     );
+    installPrimAsMethod(OutStream, sFlushExplicitly, OutFlushExplicitly);
+    installPrimAsMethod(OutStream, sFlushEvery,      OutFlushEvery     );
+    stdOut = addGlobal(_p2(MkObj, OutStream, Int(0)));
 
   fp = sp; // done at the end in the code above (intentionally) has left something on the stack
   initDone = 1;
 }
 
+// ./main bench [file.json] runs these (see the bench target in the Makefile, which also builds w/ -DNO_THREADED_DISPATCH
+// to compare)
+
+value_t mkCode(int numInstrs, ...) { // the varargs are (prim, operand) pairs
+  va_list args; va_start(args, numInstrs);
+  HandleScope;
+  value_t code = handle(mk(numInstrs));
+  for (int idx = 0; idx < numInstrs; idx++) {
+    value_t prim = va_arg(args, value_t), op = va_arg(args, value_t);
+    slotAtPut(code, Int(idx), cons(prim, op));
+  }
+  va_end(args);
+  return code;
+}
+
+// Every benchmark reports its result through report(), which prints a line and, if ./main bench was given a file name,
+// adds a record to the JSON file: the throughput, the GC pauses while it ran, and the peak RSS (of the whole process).
+
+FILE *benchJSON;
+int numBenchResults = 0;
+
+#ifdef NO_THREADED_DISPATCH
+const char *dispatchKind = "prims[]";
+#else
+const char *dispatchKind = "threaded";
+#endif
+
+size_t peakRSSKB(void) { struct rusage u; getrusage(RUSAGE_SELF, &u); return u.ru_maxrss; }
+
+double startBench(void) { // clears the pause stats, answers the start time
+  memset(pauseCounts, 0, sizeof(pauseCounts));
+  memset(pauseTotals, 0, sizeof(pauseTotals));
+  memset(pauseMaxes,  0, sizeof(pauseMaxes));
+  return now();
+}
+
+void report(const char *name, const char *unit, double numOps, double secs) {
+  if (numOps / secs >= 1e6)
+    outPrintf("%-16s %10.0f %-12s in %8.4fs: %10.3fM %s/sec\n", name, numOps, unit, secs, numOps / secs / 1e6, unit);
+  else
+    outPrintf("%-16s %10.0f %-12s in %8.4fs: %11.1f %s/sec\n", name, numOps, unit, secs, numOps / secs, unit);
+  if (benchJSON == NULL)
+    return;
+  fprintf(benchJSON, "%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"ops\": %.0f, \"seconds\": %.6f, \"opsPerSec\": %.1f,",
+          numBenchResults++ > 0 ? "," : "", name, unit, numOps, secs, numOps / secs);
+  fprintf(benchJSON, "\n     \"gcPauses\": {");
+  for (int k = 0; k < NumPauseKinds; k++) {
+    size_t count = 0;
+    for (size_t b = 0; b < NumPauseBuckets; b++)
+      count += pauseCounts[k][b];
+    fprintf(benchJSON, "%s\"%s\": {\"count\": %zu, \"totalMs\": %.3f, \"maxMs\": %.3f}", k > 0 ? ", " : "", pauseNames[k],
+            count, pauseTotals[k] * 1e3, pauseMaxes[k] * 1e3);
+  }
+  fprintf(benchJSON, "},\n     \"peakRSSKB\": %zu}", peakRSSKB());
+}
+
+void printPauses(void) {
+  for (int k = 0; k < NumPauseKinds; k++) {
+    size_t count = 0;
+    for (size_t b = 0; b < NumPauseBuckets; b++)
+      count += pauseCounts[k][b];
+    if (count == 0)
+      continue;
+    outPrintf("  %-10s pauses: %8zu, total %8.3fms, max %8.3fms, log2(us) histogram:", pauseNames[k], count,
+           pauseTotals[k] * 1e3, pauseMaxes[k] * 1e3);
+    for (size_t b = 0; b < NumPauseBuckets; b++)
+      if (pauseCounts[k][b] > 0)
+        outPrintf(" %zu:%zu", b, pauseCounts[k][b]);
+    outPrintf("\n");
+  }
+}
+
+size_t numInstrsExecuted(void) {
+  size_t n = 0;
+  for (size_t p = 0; p < numPrims; p++)
+    n += primCounts[p];
+  return n;
+}
+
+value_t benchProg(const char *name, value_t prog, const char *unit, double numOps) { // answers what prog answers
+  size_t  numInstrs = numInstrsExecuted();
+  double  start     = startBench();
+  value_t ans       = interp(prog);
+  double  secs      = now() - start;
+  report(name, unit, numOps > 0 ? numOps : numInstrsExecuted() - numInstrs, secs); // (numOps = 0 means count them)
+  return ans;
+}
+
+// runs prog, then fusedProg, which is what compiler.ojs's peephole pass makes of it (w/ superinstructions; make check-fused
+// checks that for every benchFused() in bench), and compares their dynamic instruction counts; then runs fusedProg w/ the
+// JIT (its rate is in interpreted instructions)
+value_t benchFused(const char *name, value_t prog, value_t fusedProg) {
+  char fusedName[32], jitName[32];
+  snprintf(fusedName, sizeof(fusedName), "%s fused", name);
+  snprintf(jitName,   sizeof(jitName),   "%s jit",   name);
+  size_t  n0  = numInstrsExecuted();
+  value_t ans = benchProg(name, prog, "instructions", 0);
+  size_t  n1  = numInstrsExecuted();
+  if (benchProg(fusedName, fusedProg, "instructions", 0) != ans)
+    error("a fused benchmark answered something else");
+  size_t  n2  = numInstrsExecuted();
+  outPrintf("  dynamic instruction count: %zu -> %zu (%.1f%% fewer)\n", n1 - n0, n2 - n1,
+         100.0 * (1 - (n2 - n1) / (double)(n1 - n0)));
+#if defined(__x86_64__) && !defined(NO_JIT)
+  jitEnabled = 1;
+  if (benchProg(jitName, fusedProg, "instructions", n2 - n1) != ans)
+    error("a jitted benchmark answered something else");
+  jitEnabled = 0;
+#endif
+  return ans;
+}
+
+// compares bootstrapping (initSecs is how long main's init() took) w/ starting up from an image, in a child process
+void benchImage(double initSecs) {
+  const char *path = "/tmp/nothing-bench.image";
+  report("cold init", "startups", 1, initSecs); // (w/ init()'s GC pauses)
+  saveImage(path);
+  startBench();
+  int fds[2];
+  if (pipe(fds) != 0)
+    error("couldn't make a pipe");
+  outFlush();
+  if (benchJSON != NULL)
+    fflush(benchJSON);
+  pid_t pid = fork();
+  if (pid == 0) {
+    double start = now();
+    init(0, path);
+    double secs = now() - start;
+    if (!initDone || imageBodies == NULL || send2(sAdd, Int(3), Int(4)) != Int(7))
+      secs = -1;
+    _exit(write(fds[1], &secs, sizeof(secs)) == sizeof(secs) ? 0 : 1);
+  }
+  double secs = -1;
+  if (read(fds[0], &secs, sizeof(secs)) != sizeof(secs))
+    secs = -1;
+  waitpid(pid, NULL, 0);
+  close(fds[0]);
+  close(fds[1]);
+  unlink(path);
+  if (secs < 0)
+    error("couldn't start up from the image");
+  report("image init", "startups", 1, secs);
+}
+
+// runs numThreads copies of prog as green threads on numWorkers workers, checking that they all answer expected
+void benchThreads(value_t prog, value_t expected, int numThreads, int numWorkers) {
+  char name[32];
+  snprintf(name, sizeof(name), "threads/%d", numWorkers);
+  value_t threads = addGlobal(mk(numThreads));
+  for (int i = 0; i < numThreads; i++)
+    slotAtPut(threads, Int(i), spawn(prog));
+  size_t slices = numSlices, steals = numSteals;
+  double start = startBench();
+  runThreads(numWorkers);
+  double secs = now() - start;
+  for (int i = 0; i < numThreads; i++)
+    if (slotAt(slotAt(threads, Int(i)), ctxSlot(result)) != expected)
+      error("a green thread answered the wrong thing");
+  report(name, "threads", numThreads, secs);
+  outPrintf("  %zu time slices, %zu steals\n", numSlices - slices, numSteals - steals);
+  forgetGlobal(threads);
+}
+
+void benchAlloc(const char *name, int numAllocs) { // short-lived conses and refs
+  double start = startBench();
+  for (int i = 0; i < numAllocs; i += 2) {
+    cons(Int(i), nil);
+    ref(Int(i));
+  }
+  report(name, "allocations", numAllocs, now() - start);
+}
+
+void benchIntern(const char *name, int numSyms) { // interns numSyms new strings, then each of them again
+  value_t strs = addGlobal(mkTenured(numSyms));
+  char buf[32];
+  for (int i = 0; i < numSyms; i++) {
+    snprintf(buf, sizeof(buf), "sym%d", i);
+    slotAtPut(strs, Int(i), stringify(buf));
+  }
+  double start = startBench();
+  for (int i = 0; i < 2 * numSyms; i++)
+    if (_p1(StrIntern, slotAt(strs, Int(i % numSyms))) == nil)
+      error("StrIntern failed");
+  report(name, "interns", 2 * numSyms, now() - start);
+  forgetGlobal(strs);
+}
+
+// sends println to an Int and to a cons n times each, w/ out's policy set to policy and its output going to /dev/null
+void benchPrint(const char *name, int policy, int n) {
+  value_t aCons = addGlobal(cons(Int(1), Int(2)));
+  value_t prog  = addGlobal(mkCode(18, Push,     Int(n),
+                                       PrepCall, nil, Push, sPrintln, Push, Int(1234), Send, Int(1), Pop, nil,
+                                       PrepCall, nil, Push, sPrintln, Push, aCons,     Send, Int(1), Pop, nil,
+                                       Ld,       Int(0), Push, Int(1), Sub, nil, St, Int(0), Ld, Int(0), JNZ, Int(-16),
+                                       Halt,     nil));
+  int oldFd = out.fd, oldPolicy = out.policy, devNull = open("/dev/null", O_WRONLY);
+  if (devNull < 0)
+    error("couldn't open /dev/null");
+  size_t oldFlushSize = out.flushSize;
+  outSetPolicy(policy, OutBufSize);
+  out.fd = devNull;
+  double start = startBench();
+  interp(prog);
+  outFlush();
+  double secs = now() - start;
+  out.fd = oldFd;
+  close(devNull);
+  outSetPolicy(oldPolicy, oldFlushSize);
+  report(name, "printlns", 2.0 * n, secs);
+}
+
+// looks up each method of a depth-deep hierarchy w/ numSels methods per class in its leaf class (Lookup is the slow path
+// that runs when the send caches and the method cache miss)
+void benchLookup(const char *name, int depth, int numSels) {
+  value_t cls = Obj, sels = addGlobal(mkTenured(depth * numSels));
+  char buf[32];
+  for (int d = 0; d < depth; d++) {
+    snprintf(buf, sizeof(buf), "Bench%d", d);
+    cls = _p3(MkClass, send1(sIntern, stringify(buf)), cls, nil);
+    for (int i = 0; i < numSels; i++) {
+      snprintf(buf, sizeof(buf), "bench%d/%d", d, i);
+      _p3(InstMeth, cls, slotAtPut(sels, Int(d * numSels + i), send1(sIntern, stringify(buf))), Int(i));
+    }
+  }
+  const int n = 2000000;
+  value_t oldFp = fp;
+  _p1(Push, nil);                     // load(0), i.e., the selector
+  _p1(Push, _p2(MkObj, cls, Int(0))); // load(-1), i.e., the receiver
+  fp = Int(IntValue(sp) - 2);
+  double start = startBench();
+  for (int k = 0; k < n; k++) {
+    store(Int(0), slotAt(sels, Int(k % (depth * numSels))));
+    _p(Lookup);
+  }
+  report(name, "lookups", n, now() - start);
+  _p(Pop);
+  _p(Pop);
+  fp = oldFp;
+  forgetGlobal(sels);
+}
+
+// allocates lots of short-lived conses while holding onto a big live set, and replaces part of it every now and then
+void benchGC(const char *name, int incremental, int numLive) {
+  const int numAllocs = 20000000;
+  incrementalGC = incremental;
+  value_t live = addGlobal(mkTenured(numLive));
+  double start = startBench();
+  for (int i = 0; i < numAllocs; i++) {
+    value_t c = cons(Int(i), nil);
+    if (i % 8 == 0)
+      slotAtPut(live, Int((i / 8) % numLive), c);
+  }
+  report(name, "allocations", numAllocs, now() - start);
+  printPauses();
+  for (int c = 0; c <= LargeObjects; c++) {
+    sizeClass *sc = &sizeClasses[c];
+    if (sc->numAllocs == 0)
+      continue;
+    else if (c == LargeObjects)
+      outPrintf("  large objects:  %10zu allocs, %10zu frees, %10zu live (%zu slots)\n", sc->numAllocs, sc->numFrees,
+                sc->numLive, sc->numSlotsLive);
+    else
+      outPrintf("  %2zu-slot bodies: %10zu allocs, %10zu frees, %10zu live in %zu slabs\n", sc->cellSize, sc->numAllocs,
+             sc->numFrees, sc->numLive, sc->numSlabs);
+  }
+  forgetGlobal(live);
+}
+
+value_t callWith(value_t fn, value_t x) { return interp(mkCode(5, PrepCall, nil, Push, fn, Push, x, Call, Int(1), Halt, nil)); }
+value_t sendSiteOf(value_t fn, int k)   { return slotAt(slotAt(fn, Int(0)), Int(2 * k + 1)); } // (once fn has run)
+value_t opcodeOf  (value_t fn, int k)   { return opPrim(slotAt(slotAt(fn, Int(0)), Int(2 * k))); }
+
+// checks the weak symbol table (see WEAK_SYMBOLS): a symbol that nothing else refers to is tombstoned by a major
+// collection, and by a minor one while it's young, an equal string is interned again afterwards, and symbols that are
+// still referred to stay put
+void checkWeakSymbols(void) {
+  const char *name = "weak symbol check";
+  for (int major = 1; major >= 0; major--) {
+    value_t table;
+    int     idx;
+    {
+      HandleScope;
+      value_t sym = handle(_p1(StrIntern, stringify(name)));
+      table = deref(internedStringsRef);
+      idx   = symbolTableIdx(table, sym, strHash(sym));
+      if (slotAt(asSymbolTable(table)->strings, Int(idx)) != sym || (!major && !isYoung(OopValue(sym))))
+        error("the weak symbol check couldn't set itself up");
+    }
+    if (major) gc(); else minorGC(); // (nothing refers to sym now)
+    if (deref(internedStringsRef) != table || slotAt(asSymbolTable(table)->strings, Int(idx)) != Tombstone)
+      error("a symbol that nothing refers to wasn't tombstoned");
+    HandleScope;
+    value_t again = handle(_p1(StrIntern, stringify(name)));
+    if (_p1(StrIntern, stringify(name)) != again || strCmp(again, stringify(name)) != 0)
+      error("a tombstoned symbol wasn't interned again");
+  }
+  if (_p1(StrIntern, stringify("print")) != sPrint)
+    error("a symbol that's still referred to was reclaimed");
+}
+
+// checks the send sites that bytecode() assembles: each one has its own send cache, which is monomorphic once it's seen
+// an Int and polymorphic once it's seen nil too, and a + site is quickened to SendAdd once it's seen enough Ints (see
+// profileSend), and goes back to Send when something else shows up
+void checkSendSites(void) {
+  // (lambda (x) (x identityHash)) and (lambda (x) (x + 1)), w/ the send at instruction 3 and 4, respectively
+  value_t hashFn = constClosure(mkCode(5, PrepCall, nil, Push, sIdentityHash, Arg, Int(1), Send, Int(1), Ret, nil));
+  value_t addFn  = constClosure(mkCode(6, PrepCall, nil, Push, sAdd, Arg, Int(1), Push, Int(1), Send, Int(2), Ret, nil));
+  value_t cls    = _p3(MkClass, send1(sIntern, stringify("CheckAdder")), Obj, nil);
+  _p3(InstMeth, cls, sAdd, constClosure(mkCode(2, Push, Int(42), Ret, nil)));
+  value_t adder  = addGlobal(_p2(MkObj, cls, Int(0)));
+  callWith(hashFn, Int(7));
+  if (!isOop(sendSiteOf(hashFn, 3)) || asSendCache(sendSiteOf(hashFn, 3))->numEntries != Int(1))
+    error("a send site didn't get a monomorphic send cache");
+  callWith(hashFn, nil);
+  if (asSendCache(sendSiteOf(hashFn, 3))->numEntries != Int(2))
+    error("a send site didn't go polymorphic");
+
+  for (int i = 0; i < QuickenThreshold + 1; i++)
+    if (callWith(addFn, Int(i)) != Int(i + 1))
+      error("a + send answered the wrong thing");
+  if (opcodeOf(addFn, 4) != SendAdd)
+    error("a + send site wasn't quickened");
+  if (callWith(addFn, adder) != Int(42) || opcodeOf(addFn, 4) != Send)
+    error("a quickened + send site didn't go back to Send");
+  forgetGlobal(adder);
+}
+
+void checkThreads(void) { // runs threads that allocate, and threads that send, on 4 workers (however many cores there are)
+  const int numThreads = 16, numWorkers = 4, c = 100000, s = 100000;
+  HandleScope;
+  // the closures and int arith programs from bench(), w/ lambdas that are only assembled once the workers are running
+  value_t l3 = handle(mkCode(4,  Fv,       Int(0), Arg,  Int(1), Sub,   nil,    Ret,  nil));
+  value_t l4 = handle(mkCode(4,  Push,     l3,     Arg,  Int(1), MkFun, Int(1), Ret,  nil));
+  value_t l5 = handle(mkCode(20, Arg,      Int(1), Push, Int(0), Eq,    nil,    JZ,   Int(2),  Arg,  Int(2), Jmp, Int(13),
+                                 Arg,      Int(0), Arg,  Int(1), Push,  Int(1), Sub,  nil,
+                                 PrepCall, nil,    PrepCall, nil,  Push,  l4,     MkFun, Int(0), Arg,  Int(1), Call, Int(1),
+                                 Arg,      Int(2), Call, Int(1), TCall, Int(2),
+                                 Ret,      nil));
+  value_t closures = handle(mkCode(7, PrepCall, nil, Push, l5, MkFun, Int(0), Push, Int(c), Push, Int(0), Call, Int(2),
+                                      Halt, nil));
+  value_t arith    = handle(mkCode(16, Push,     Int(s),
+                                       Push,     Int(0),
+                                       PrepCall, nil, Push, sAdd, Ld, Int(-1), Push, Int(1), Send, Int(2),
+                                       St,       Int(-1),
+                                       Ld,       Int(0), Push, Int(1), Sub, nil, St, Int(0), Ld, Int(0), JNZ, Int(-12),
+                                       St,       Int(0),
+                                       Halt,     nil));
+  value_t threads  = handle(mk(numThreads));
+  for (int i = 0; i < numThreads; i++)
+    slotAtPut(threads, Int(i), spawn(i % 2 == 0 ? closures : arith));
+  size_t minorGCs = gcCounts.minorGCs;
+  runThreads(numWorkers);
+  int expected = 0;
+  for (int i = c; i > 0; i--)
+    expected = i - expected;
+  for (int i = 0; i < numThreads; i++)
+    if (slotAt(slotAt(threads, Int(i)), ctxSlot(result)) != Int(i % 2 == 0 ? expected : s))
+      error("a green thread answered the wrong thing on %d workers", numWorkers);
+  if (gcCounts.minorGCs == minorGCs)
+    error("the threads on %d workers didn't collect any garbage", numWorkers);
+}
+
+void bench(double initSecs, const char *jsonPath) {
+  if (jsonPath != NULL && (benchJSON = fopen(jsonPath, "w")) == NULL)
+    error("couldn't open the JSON file");
+  if (benchJSON != NULL)
+    fprintf(benchJSON, "{\"dispatch\": \"%s\",\n \"results\": [", dispatchKind);
+  outPrintf("(%s dispatch)\n", dispatchKind);
+  jitEnabled = 0; // (see benchFused)
+
+  benchImage(initSecs);
+
+  const int n = 10000000;
+  value_t loop = addGlobal(mkCode(8, Push, Int(n),       // the counter lives at load(0)
+                                     Ld,   Int(0),
+                                     Push, Int(1),
+                                     Sub,  nil,
+                                     St,   Int(0),
+                                     Ld,   Int(0),
+                                     JNZ,  Int(-6),
+                                     Halt, nil));
+  value_t loopF = addGlobal(mkCode(7, Push, Int(n), Ld, Int(0), SubI, Int(1), St, Int(0), Ld, Int(0), JNZ, Int(-5), Halt, nil));
+  benchFused("loop", loop, loopF);
+
+  // ((lambda (n) (if (= n 0) 0 (thisFunction (- n 1)))) m), as compiled by compiler.ojs (w/o and w/ the peephole pass)
+  const int m = 2000000;
+  value_t l1    = addGlobal(mkCode(12, Arg,  Int(1), Push, Int(0), Eq,    nil,    JZ,   Int(2), Push, Int(0), Jmp, Int(5),
+                                       Arg,  Int(0), Arg,  Int(1), Push,  Int(1), Sub,  nil,    TCall, Int(1),
+                                       Ret,  nil));
+  value_t l1F   = addGlobal(mkCode(9,  Arg,  Int(1), JNZ,  Int(2), Push,  Int(0), Jmp,  Int(4),
+                                       Arg,  Int(0), Arg,  Int(1), SubI,  Int(1), TCall, Int(1),
+                                       Ret,  nil));
+  value_t prog  = addGlobal(mkCode(6, PrepCall, nil, Push, l1,  MkFun, Int(0), Push, Int(m), Call, Int(1), Halt, nil));
+  value_t progF = addGlobal(mkCode(5, PrepCall, nil, Push, constClosure(l1F), Push, Int(m), Call, Int(1), Halt, nil));
+  benchFused("tailcalls", prog, progF);
+
+  // ((lambda (n) (if (= n 0) 0 (if (= n 1) 1 (+ (thisFunction (- n 1)) (thisFunction (- n 2)))))) f)
+  const int f = 27;
+  value_t l2 = addGlobal(mkCode(26, Arg,      Int(1), Push, Int(0), Eq,   nil,    JZ,   Int(2), Push, Int(0), Jmp,  Int(19),
+                                    Arg,      Int(1), Push, Int(1), Eq,   nil,    JZ,   Int(2), Push, Int(1), Jmp,  Int(13),
+                                    PrepCall, nil,    Arg,  Int(0), Arg,  Int(1), Push, Int(1), Sub,  nil,    Call, Int(1),
+                                    PrepCall, nil,    Arg,  Int(0), Arg,  Int(1), Push, Int(2), Sub,  nil,    Call, Int(1),
+                                    Add,      nil,
+                                    Ret,      nil));
+  value_t l2F = addGlobal(mkCode(21, Arg,      Int(1), JNZ,  Int(2), Push, Int(0), Jmp,  Int(16),
+                                     Arg,      Int(1), Push, Int(1), JNE,  Int(2), Push, Int(1), Jmp, Int(11),
+                                     PrepCall, nil,    Arg,  Int(0), Arg,  Int(1), SubI, Int(1), Call, Int(1),
+                                     PrepCall, nil,    Arg,  Int(0), Arg,  Int(1), SubI, Int(2), Call, Int(1),
+                                     Add,      nil,
+                                     Ret,      nil));
+  prog  = addGlobal(mkCode(6, PrepCall, nil, Push, l2,  MkFun, Int(0), Push, Int(f), Call, Int(1), Halt, nil));
+  progF = addGlobal(mkCode(5, PrepCall, nil, Push, constClosure(l2F), Push, Int(f), Call, Int(1), Halt, nil));
+  benchFused("fib", prog, progF);
+
+  // ((lambda (n acc) (if (= n 0) acc (thisFunction (- n 1) (((lambda (x) (lambda (y) (- x y))) n) acc)))) c 0), which
+  // makes two closures per iteration, one of which has a free variable (the fused version only makes that one, since the
+  // other one captures nothing, see constClosure)
+  const int c = 1000000;
+  value_t l3 = addGlobal(mkCode(4,  Fv,       Int(0), Arg,  Int(1), Sub,   nil,    Ret,  nil));
+  value_t l4 = addGlobal(mkCode(4,  Push,     l3,     Arg,  Int(1), MkFun, Int(1), Ret,  nil));
+  value_t l5 = addGlobal(mkCode(20, Arg,      Int(1), Push, Int(0), Eq,    nil,    JZ,   Int(2),  Arg,  Int(2), Jmp, Int(13),
+                                    Arg,      Int(0), Arg,  Int(1), Push,  Int(1), Sub,  nil,
+                                    PrepCall, nil,    PrepCall, nil,  Push,  l4,     MkFun, Int(0), Arg,  Int(1), Call, Int(1),
+                                    Arg,      Int(2), Call, Int(1), TCall, Int(2),
+                                    Ret,      nil));
+  value_t l5F = addGlobal(mkCode(16, Arg,      Int(1), JNZ,  Int(2), Arg,  Int(2), Jmp,  Int(11),
+                                     Arg,      Int(0), Arg,  Int(1), SubI, Int(1),
+                                     PrepCall, nil,    PrepCall, nil,  Push,  constClosure(l4), Arg,  Int(1), Call, Int(1),
+                                     Arg,      Int(2), Call, Int(1), TCall, Int(2),
+                                     Ret,      nil));
+  prog  = addGlobal(mkCode(7, PrepCall, nil, Push, l5,  MkFun, Int(0), Push, Int(c), Push, Int(0), Call, Int(2), Halt, nil));
+  progF = addGlobal(mkCode(6, PrepCall, nil, Push, constClosure(l5F), Push, Int(c), Push, Int(0), Call, Int(2), Halt, nil));
+  int expected = 0;
+  for (int i = c; i > 0; i--)
+    expected = i - expected;
+  if (benchFused("closures", prog, progF) != Int(expected))
+    error("the closures benchmark answered the wrong thing");
+
+  // 4 sends (to an Int, nil, a cons, and a string) per iteration, each from its own send site
+  const int s = 2000000;
+  value_t aCons = addGlobal(cons(nil, nil));
+  value_t sends = addGlobal(mkCode(28, Push,     Int(s),
+                                       PrepCall, nil, Push, sIdentityHash, Push, Int(7),       Send, Int(1), Pop, nil,
+                                       PrepCall, nil, Push, sIdentityHash, Push, nil,          Send, Int(1), Pop, nil,
+                                       PrepCall, nil, Push, sIdentityHash, Push, aCons,        Send, Int(1), Pop, nil,
+                                       PrepCall, nil, Push, sIdentityHash, Push, sAdd,         Send, Int(1), Pop, nil,
+                                       Ld,       Int(0), Push, Int(1), Sub, nil, St, Int(0), Ld, Int(0), JNZ, Int(-26),
+                                       Halt,     nil));
+  benchProg("sends", sends, "sends", 4.0 * s);
+
+  // acc := acc + 1, w/ a send that goes to IntAdd, s times
+  value_t arith = addGlobal(mkCode(16, Push,     Int(s),                               // the counter lives at load(0)
+                                       Push,     Int(0),                               // ... and acc at load(-1)
+                                       PrepCall, nil, Push, sAdd, Ld, Int(-1), Push, Int(1), Send, Int(2),
+                                       St,       Int(-1),
+                                       Ld,       Int(0), Push, Int(1), Sub, nil, St, Int(0), Ld, Int(0), JNZ, Int(-12),
+                                       St,       Int(0),
+                                       Halt,     nil));
+  if (benchProg("int arith", arith, "sends", s) != Int(s))
+    error("the int arith benchmark answered the wrong thing");
+  checkSendSites();
+
+  benchAlloc("alloc", 20000000);
+  benchIntern("intern", 100000);
+  if (weakSymbols)
+    checkWeakSymbols();
+  benchLookup("lookup", 8, 100);
+  benchPrint("print line",     OutLine, 200000);
+  benchPrint("print buffered", OutSize, 200000);
+
+  // fib(20) in 64 threads, on 1, 2, 4, and 8 workers (as many of them as there are cores for)
+  value_t fibs  = addGlobal(mkCode(6, PrepCall, nil, Push, l2, MkFun, Int(0), Push, Int(20), Call, Int(1), Halt, nil));
+  int     cores = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int w = 1; w <= 8 && (w == 1 || w <= cores); w *= 2)
+    benchThreads(fibs, Int(6765), 64, w);
+  checkThreads();
+
+  benchGC("gc",         0,  200000);
+  benchGC("incr gc",    1,  200000);
+  benchGC("gc big",     0, 2000000);
+
+  outPrintf("peak RSS: %zuKB\n", peakRSSKB());
+  if (benchJSON != NULL) {
+    fprintf(benchJSON, "\n ],\n \"peakRSSKB\": %zu}\n", peakRSSKB());
+    fclose(benchJSON);
+  }
+}
+
 int main(int argc, char *argv[]) {
-  init(argc > 1);
+  if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+    double start = now();
+    init(0);
+    bench(now() - start, argc > 2 ? argv[2] : NULL);
+    return 0;
+  }
+  if (argc > 2 && strcmp(argv[1], "save-image") == 0) {
+    init(0);
+    saveImage(argv[2]);
+    return 0;
+  }
+  else if (argc > 2 && strcmp(argv[1], "run-module") == 0) { // loads a module (see loadModule), runs it, prints the answer
+    init(0);
+    value_t ans = interp(_p1(LoadModule, stringify(argv[2])));
+    printf2("%o\n", ans);
+    return 0;
+  }
+  else if (argc > 2 && strcmp(argv[1], "load-image") == 0) // runs the rest from the image (if it's any good)
+    init(0, argv[2]);
+  else
+    init(argc > 1);
   value_t ans = send1(sPrintln, send1(sIntern, stringify("Object>>println and send macro worked!"))); printf2(" => %o\n", ans);
           ans = send1(sPrintln, Int(42));                                                             printf2(" => %o\n", ans);
           ans = send1(sPrintln, Int(42));                                                             printf2(" => %o\n", ans);
@@ -597,9 +4005,9 @@ int main(int argc, char *argv[]) {
           ans = send2(sSub,     Int(5), Int(6));                                                      printf2(" => %o\n", ans);
           ans = send1(sPrintln, send1(sIdentityHash, cons(nil, nil)));                                printf2(" => %o\n", ans);
           ans = send1(sPrintln, send1(sIdentityHash, Int(1234)));                                     printf2(" => %o\n", ans);
-  value_t sX  = send1(sIntern,  stringify("x")),
-          sY  = send1(sIntern,  stringify("y"));
-  value_t Point = _p3(MkClass, send1(sIntern, stringify("Point")), Obj, cons(sX, sY));
+  value_t sX  = addGlobal(send1(sIntern, stringify("x"))), // added to the globals in case the symbol table is weak
+          sY  = addGlobal(send1(sIntern, stringify("y")));
+  value_t Point = _p3(MkClass, addGlobal(send1(sIntern, stringify("Point"))), Obj, cons(sX, sY));
   value_t p     = _p2(MkObj, Point, Int(0));
   send2(sX, p, Int(1234));
   send2(sY, p, Int(4321));